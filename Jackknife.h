@@ -0,0 +1,297 @@
+#ifndef JACKKNIFE_H
+#define JACKKNIFE_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+#include <healpix_map.h>
+
+#include <Twopt_Table.h>
+#include <Pixel_Triangles.h>
+#include <Quadrilateral_List_File.h>
+
+namespace {
+  /// @cond IDTAG
+  const std::string JACKKNIFE_RCSID
+  ("$Id$");
+  /// @endcond
+}
+
+namespace Npoint_Functions {
+  /** Region resolved sums for jackknife error estimates.
+   *
+   *  The sky is divided into regions labelled 0, 1, ..., Nregion-1.  An
+   *  npoint function is accumulated as a sum of products and a count (of
+   *  pairs, triangles, or quadrilaterals) for each region.  Each product
+   *  is assigned to the region of its first vertex.  From the region sums
+   *  all the delete-one jackknife estimates are found at no extra cost,
+   *  see delete_one().  Thus a single pass through the tables replaces
+   *  one run per jackknife region.
+   */
+  class Jackknife_Sums {
+  private :
+    std::vector<double> S; // Sum of products in each region.
+    std::vector<double> N; // Number of products in each region.
+  public :
+    /// Construct the sums for \a Nregion regions.
+    Jackknife_Sums (size_t Nregion=0) : S(Nregion, 0), N(Nregion, 0) {}
+
+    /** Reset the sums.
+     *  All sums are zeroed and the number of regions set to \a Nregion.
+     */
+    inline void reset (size_t Nregion)
+    { S.assign (Nregion, 0); N.assign (Nregion, 0); }
+
+    /// Add the sum of \a count products, \a value, to region \a r.
+    inline void add (size_t r, double value, double count)
+    { S[r] += value; N[r] += count; }
+
+    /// Add all the sums of \a sums, which has the same number of regions.
+    void add (const Jackknife_Sums& sums)
+    {
+      for (size_t r=0; r < S.size(); ++r) {
+        S[r] += sums.S[r];
+        N[r] += sums.N[r];
+      }
+    }
+
+    /// \name Accessors
+    //@{
+    /// The number of regions.
+    inline size_t Nregion () const { return S.size(); }
+    /// The number of products in region \a r.
+    inline double count (size_t r) const { return N[r]; }
+    /// The number of products in all regions.
+    double count () const
+    {
+      double Ntot = 0;
+      for (size_t r=0; r < N.size(); ++r) Ntot += N[r];
+      return Ntot;
+    }
+    /// The npoint function using all regions.
+    double value () const
+    {
+      double Stot = 0, Ntot = 0;
+      for (size_t r=0; r < S.size(); ++r) {
+        Stot += S[r];
+        Ntot += N[r];
+      }
+      return ((Ntot > 0) ? Stot/Ntot : 0);
+    }
+    //@}
+
+    /** The delete-one jackknife estimates.
+     *  On return \a C[r] is the npoint function calculated with region \a
+     *  r removed.
+     */
+    void delete_one (std::vector<double>& C) const
+    {
+      double Stot = 0, Ntot = 0;
+      for (size_t r=0; r < S.size(); ++r) {
+        Stot += S[r];
+        Ntot += N[r];
+      }
+      C.resize (S.size());
+      for (size_t r=0; r < S.size(); ++r) {
+        C[r] = ((Ntot > N[r]) ? (Stot-S[r])/(Ntot-N[r]) : 0);
+      }
+    }
+  };
+
+  /** Jackknife covariance between bins.
+   *  Given the delete-one estimates for each bin, \a Cdel[k][r] (see
+   *  Jackknife_Sums::delete_one()), the jackknife covariance
+   *  \f[ {\rm Cov}_{kl} = \frac{R-1}{R} \sum_r
+   *     (C_{k,-r}-\bar C_k) (C_{l,-r}-\bar C_l) \f]
+   *  is returned in \a cov as an Nbin x Nbin matrix in row major order.
+   *
+   *  \relates Jackknife_Sums
+   */
+  void jackknife_covariance (const std::vector<std::vector<double> >& Cdel,
+                             std::vector<double>& cov)
+  {
+    size_t Nbin = Cdel.size();
+    cov.assign (Nbin*Nbin, 0);
+    if (Nbin == 0) return;
+    size_t R = Cdel[0].size();
+    if (R < 2) return;
+    std::vector<double> Cmean (Nbin, 0);
+    for (size_t k=0; k < Nbin; ++k) {
+      for (size_t r=0; r < R; ++r) Cmean[k] += Cdel[k][r];
+      Cmean[k] /= R;
+    }
+    for (size_t k=0; k < Nbin; ++k) {
+      for (size_t l=k; l < Nbin; ++l) {
+        double c = 0;
+        for (size_t r=0; r < R; ++r) {
+          c += (Cdel[k][r]-Cmean[k]) * (Cdel[l][r]-Cmean[l]);
+        }
+        cov[k*Nbin+l] = cov[l*Nbin+k] = c * (R-1) / R;
+      }
+    }
+  }
+
+  /** Convert a map of region labels to a list of labels.
+   *  The labels are rounded to the nearest integer and returned by pixel
+   *  number in \a region.  The number of regions, one more than the
+   *  largest label, is returned.  Pixels with a negative or non-finite
+   *  label, such as UNSEEN, are not in any region.  A label too large
+   *  for an int is an error and 0 is returned.
+   *
+   *  \relates Jackknife_Sums
+   */
+  size_t region_list (const Healpix_Map<double>& region_map,
+                      std::vector<int>& region)
+  {
+    int Nregion = 0;
+    region.resize (region_map.Npix());
+    for (int p=0; p < region_map.Npix(); ++p) {
+      double r = std::floor(region_map[p]+0.5);
+      // NaN fails every comparison so is caught here as well.
+      if (! (r >= 0)) {
+        region[p] = -1;
+        continue;
+      }
+      if (r >= std::numeric_limits<int>::max()) {
+        std::cerr << "Region label " << region_map[p] << " of pixel " << p
+                  << " is too large\n";
+        return 0;
+      }
+      region[p] = static_cast<int>(r);
+      Nregion = std::max (Nregion, region[p]+1);
+    }
+    return Nregion;
+  }
+
+  /** Calculate the region resolved two point function for one bin.
+   *  This is the same as calculate_twopt_function() except the sums are
+   *  accumulated in \a sums by the region of the first pixel of the pair
+   *  (the smaller pixel number).  Rows for pixels with a negative region
+   *  label are skipped.
+   *
+   *  \relates Jackknife_Sums
+   */
+  template<typename TM, typename T>
+  void calculate_twopt_function_jackknife (const Healpix_Map<TM>& map,
+                                           const std::vector<int>& region,
+                                           const Twopt_Table<T>& table,
+                                           Jackknife_Sums& sums)
+  {
+    size_t Npair;
+    TM Csum;
+    T p1, p2;
+    for (size_t i=0; i < table.Npix(); ++i) {
+      p1 = table.pixel_list(i);
+      if (region[p1] < 0) continue;
+      Csum = 0;
+      Npair = 0;
+      for (size_t j=0; ((j < table.Nmax()) && (table(i,j) != -1)); ++j) {
+        p2 = table.pixel_list(table(i,j));
+        if (p1 > p2) continue; // Avoid double counting.
+        ++Npair;
+        Csum += map[p2];
+      }
+      sums.add (region[p1], map[p1] * Csum, Npair);
+    }
+  }
+
+  /** Calculate the region resolved three point function for one bin.
+   *  The product of the map values at the corners of each triangle is
+   *  accumulated in \a sums by the region of the first pixel of the
+   *  triangle.  Triangles whose first pixel has a negative region label
+   *  are skipped.
+   *
+   *  \relates Jackknife_Sums
+   */
+  template<typename TM, typename T>
+  void calculate_threepoint_function_jackknife
+  (const Healpix_Map<TM>& map, const std::vector<int>& region,
+   const Pixel_Triangles<T>& triangles, Jackknife_Sums& sums)
+  {
+    for (size_t j=0; j < triangles.size(); ++j) {
+      T p1 = triangles.get(j,0);
+      if (region[p1] < 0) continue;
+      sums.add (region[p1], map[p1] * map[triangles.get(j,1)]
+                * map[triangles.get(j,2)], 1);
+    }
+  }
+
+  /** Region resolved three point function kernel for the triangle
+   *  visitors.
+   *  This is the same as Threepoint_Kernel except the sums are
+   *  accumulated by the region of the first vertex, as in
+   *  calculate_threepoint_function_jackknife().  Rows for pixels with a
+   *  negative region label are skipped.  Used with
+   *  visit_in_blocks() the triangles are never stored.
+   *
+   *  \relates Jackknife_Sums
+   */
+  template<typename TM, typename T>
+  class Threepoint_Jackknife_Kernel {
+  private :
+    const Healpix_Map<TM>& map;
+    const std::vector<int>& region;
+    const Twopt_Table<T>& table;
+    Jackknife_Sums S;
+  public :
+    Threepoint_Jackknife_Kernel (const Healpix_Map<TM>& map_,
+                                 const std::vector<int>& region_,
+                                 size_t Nregion,
+                                 const Twopt_Table<T>& table_)
+      : map(map_), region(region_), table(table_), S(Nregion) {}
+    /// Zero the sums.
+    inline void reset () { S.reset (S.Nregion()); }
+    /// Add the sums from \a k, see visit_in_blocks().
+    inline void add (const Threepoint_Jackknife_Kernel& k) { S.add (k.S); }
+    inline void operator() (T i1, T i2, const std::vector<T>& matches)
+    {
+      T p1 = table.pixel_list(i1);
+      if (region[p1] < 0) return;
+      TM Csum = 0;
+      for (size_t k=0; k < matches.size(); ++k) {
+        Csum += map[table.pixel_list(matches[k])];
+      }
+      S.add (region[p1], map[p1] * map[table.pixel_list(i2)] * Csum,
+             matches.size());
+    }
+    /// The region resolved sums.
+    inline const Jackknife_Sums& sums () const { return S; }
+  };
+
+  /** Calculate the region resolved four point function for one bin.
+   *  This is the same as calculate_fourpoint_function() except the sums
+   *  are accumulated in \a sums by the region of the first pixel of the
+   *  quadrilaterals (p0 in the list).  Quadrilaterals whose first pixel
+   *  has a negative region label are skipped.
+   *
+   *  \relates Jackknife_Sums
+   */
+  template<typename TM, typename TL>
+  void calculate_fourpoint_function_jackknife
+  (const Healpix_Map<TM>& map, const std::vector<int>& region,
+   Quadrilateral_List_File<TL>& qlf, Jackknife_Sums& sums)
+  {
+    TL *arr;
+    size_t Nquad;
+    TM C;
+
+    while ((arr = qlf.next()) != 0) {
+      if (region[arr[0]] < 0) continue;
+      Nquad = 0;
+      C = fourpoint_record_sum (map, arr, Nquad);
+      sums.add (region[arr[0]], C, Nquad);
+    }
+  }
+}
+
+#endif
+
+/* For emacs, this is a c++ header
+ * Local Variables:
+ * mode: c++
+ * End:
+ */
@@ -6,10 +6,16 @@
 #include <fstream>
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <cmath>
 
 #include <Twopt_Table.h>
+#include <Pixel_Vector_Cache.h>
 
 #include <healpix_base.h>
+#include <healpix_map.h>
+#include <string_utils.h> // For parsing a text file
+#include <paramfile.h>
 #include <vec3.h>
 
 namespace {
@@ -115,6 +121,42 @@ namespace Npoint_Functions {
     return !(iss >> val).fail();
   }
 
+  /** Convert a string to a list of values.
+   *  The string is either a comma separated list, such as "10,20,35", or
+   *  a range "min:max:step" which includes max if it is reached to within
+   *  rounding, so "10:30:5" is 10, 15, 20, 25, 30.  A single value is a
+   *  list of length one.
+   */
+  bool parse_value_list (const std::string& instr, std::vector<double>& vals)
+  {
+    vals.clear();
+    std::vector<std::string> fields;
+    std::string::size_type start = 0, end;
+    char sep = (instr.find(':') != std::string::npos) ? ':' : ',';
+    do {
+      end = instr.find (sep, start);
+      fields.push_back (instr.substr (start, end-start));
+      start = end + 1;
+    } while (end != std::string::npos);
+
+    double v;
+    if (sep == ':') {
+      double vmin, vmax, dv;
+      if ((fields.size() != 3) || (! from_string (fields[0], vmin))
+          || (! from_string (fields[1], vmax))
+          || (! from_string (fields[2], dv)) || (dv <= 0))
+        return false;
+      size_t N = static_cast<size_t>(std::floor ((vmax-vmin)/dv + 1e-6)) + 1;
+      for (size_t j=0; j < N; ++j) vals.push_back (vmin + j*dv);
+    } else {
+      for (size_t j=0; j < fields.size(); ++j) {
+        if (! from_string (fields[j], v)) return false;
+        vals.push_back (v);
+      }
+    }
+    return (vals.size() > 0);
+  }
+
   /** Fill a list with HEALpix vectors.
    *  Helper function to create a list of vectors pointing to HEALPix pixel
    *  centers.  The vectors are labelled by the pixel INDEX in the two
@@ -124,26 +166,25 @@ namespace Npoint_Functions {
   void fill_vector_list (const Npoint_Functions::Twopt_Table<T>& t,
                          std::vector<vec3>& veclist)
   {
-    Healpix_Base HBase (t.Nside(), t.Scheme(), SET_NSIDE);
+    const vec3 *v = pixel_vectors (t.Nside(), t.Scheme());
     veclist.resize (t.Npix());
     for (size_t i=0; i < t.Npix(); ++i) {
-      veclist[i] = HBase.pix2vec (t.pixel_list(i));
+      veclist[i] = v[t.pixel_list(i)];
     }
   }
 
   /** Fill a list with HEALpix vectors.
    *  Helper function to create a list of vectors pointing to HEALPix pixel
    *  centers.  All vectors for the provided \a Nside are calculated in the
-   *  \a scheme HEALPix ordering scheme.
+   *  \a scheme HEALPix ordering scheme.  This is a copy of the shared
+   *  vectors from pixel_vectors() which should be used directly when a
+   *  copy is not needed.
    */
   void fill_vector_list (size_t Nside, Healpix_Ordering_Scheme scheme,
                          std::vector<vec3>& veclist)
   {
-    Healpix_Base HBase (Nside, scheme, SET_NSIDE);
-    veclist.resize (HBase.Npix());
-    for (size_t i=0; i < veclist.size(); ++i) {
-      veclist[i] = HBase.pix2vec (i);
-    }
+    const vec3 *v = pixel_vectors (Nside, scheme);
+    veclist.assign (v, v + 12*Nside*Nside);
   }
 
   /** Generate a range of values.
@@ -175,6 +216,224 @@ namespace Npoint_Functions {
      */
     inline void reset() { curr = next = start; }
   };
+
+  /** Convert a mask to a list of pixels.
+   *  All pixels with a mask value greater than one half are kept.  The
+   *  pixel numbers are in the scheme of the mask.
+   */
+  void mask_to_pixlist (const Healpix_Map<double>& mask,
+                        std::vector<int>& pixlist)
+  {
+    pixlist.clear();
+    for (int j=0; j < mask.Npix(); ++j) {
+      if (mask[j] > 0.5) pixlist.push_back(j);
+    }
+  }
+
+  /** Read the columns of numbers in a text file.
+   *  The file is read line by line and the values on each line are
+   *  returned as a row of \a rows.  Anything following a # is a comment
+   *  and blank lines are skipped.
+   */
+  bool read_columns (const std::string& filename,
+                     std::vector<std::vector<double> >& rows)
+  {
+    std::string line;
+    std::string::iterator it;
+    std::vector<double> vals;
+    std::ifstream in (filename.c_str());
+    if (! in.is_open()) return false;
+
+    rows.clear();
+    while (in.good()) {
+      std::getline (in, line);
+      line = trim (line);
+      it = std::find (line.begin(), line.end(), '#');
+      if (it != line.end()) line.erase (it, line.end());
+      if (line == "") continue;
+      vals.clear();
+      split (line, vals);
+      rows.push_back (vals);
+    }
+    in.close();
+    return true;
+  }
+
+  /** Read a list of bin values from a text file.
+   *  The first column is extracted, see read_columns().
+   */
+  bool read_bin_file (const std::string& cosbinfile,
+                      std::vector<double>& bin_list)
+  {
+    std::vector<std::vector<double> > rows;
+    if (! read_columns (cosbinfile, rows)) return false;
+
+    bin_list.clear();
+    for (size_t i=0; i < rows.size(); ++i) {
+      if (rows[i].size() > 0) bin_list.push_back (rows[i][0]);
+    }
+    return true;
+  }
+
+  /** Gauss-Legendre quadrature abscissas and weights.
+   *  The \a N abscissas, the zeros of \f$P_N(x)\f$, are returned in
+   *  ascending order in \a x and the corresponding weights in \a w so that
+   *  \f[ \int_{-1}^1 f(x) dx = \sum_i w_i f(x_i) \f]
+   *  is exact for polynomials of degree 2N-1 or less.  The zeros are found
+   *  by Newton's method starting from the standard asymptotic estimate.
+   */
+  void gauss_legendre (size_t N, std::vector<double>& x,
+                       std::vector<double>& w)
+  {
+    x.resize (N);
+    w.resize (N);
+    double z, z1, P0, P1, P2, dP = 0;
+    // Only half the zeros are needed due to symmetry.
+    for (size_t i=0; i < (N+1)/2; ++i) {
+      z = std::cos (M_PI * (i+0.75) / (N+0.5));
+      for (int iter=0; iter < 100; ++iter) {
+        P1 = 1;
+        P2 = 0;
+        for (size_t l=1; l <= N; ++l) {
+          P0 = P2;
+          P2 = P1;
+          P1 = ((2*l-1)*z*P2 - (l-1)*P0) / l;
+        }
+        // Now P1 = P_N(z) and P2 = P_{N-1}(z).
+        dP = N * (z*P1 - P2) / (z*z - 1);
+        z1 = z;
+        z = z1 - P1/dP;
+        if (std::fabs(z-z1) < 1e-15) break;
+      }
+      x[i] = -z;
+      x[N-1-i] = z;
+      w[i] = w[N-1-i] = 2 / ((1-z*z) * dP*dP);
+    }
+  }
+
+  /** Create the two point bins from a parameter file.
+   *  The bins are set by one of \a cosbinfile (a text file of bin
+   *  values in cos(theta)), \a dcosbin (equal width bins in cos(theta)),
+   *  \a dtheta (equal width bins in theta, in degrees), or \a
+   *  gauss_legendre_lmax (bins centered on the lmax+1 Gauss-Legendre
+   *  abscissas, see gauss_legendre(), for reconstructing the C_l up to
+   *  lmax by quadrature).  The value at the center of each bin is
+   *  returned in \a bin_list and the edges of the bins in \a cosbin.  The
+   *  edges are always in increasing order and inclusive, the first is less
+   *  than -1 and the last greater than 1, so every dot product falls in a
+   *  bin.  On error a message is printed and false is returned.
+   */
+  bool create_bins (paramfile& params, std::vector<double>& bin_list,
+                    std::vector<double>& cosbin)
+  {
+    double dcosbin = params.find<double> ("dcosbin", -100);
+    double dtheta = params.find<double> ("dtheta", -200);
+    std::string cosbinfile = params.find<std::string> ("cosbinfile", "");
+    int gl_lmax = params.find<int> ("gauss_legendre_lmax", -1);
+
+    if ((dcosbin == -100) && (cosbinfile == "") && (dtheta == -200)
+        && (gl_lmax == -1)) {
+      std::cerr << "cosbinfile or dcosbin or dtheta or gauss_legendre_lmax must be set in the parameter file.\n";
+      return false;
+    }
+
+    cosbin.clear();
+    if (gl_lmax >= 0) {
+      std::vector<double> weight;
+      gauss_legendre (gl_lmax+1, bin_list, weight);
+    } else if (cosbinfile != "") {
+      if (! read_bin_file (cosbinfile, bin_list)) {
+        std::cerr << "Failed reading " << cosbinfile << std::endl;
+        return false;
+      }
+    } else if (dcosbin != -100) {
+      int Nbin = 2/dcosbin;
+      bin_list.resize(Nbin);
+      std::generate (bin_list.begin(), bin_list.end(),
+                     myRange<double>(-1.0+dcosbin/2, dcosbin));
+    } else {
+      int Nbin = 180/dtheta;
+      bin_list.resize(Nbin);
+      /* Run this "backward" since we will use bins in cos(theta) and
+       * cos(180)=-1. */
+      std::generate (bin_list.begin(), bin_list.end(),
+                     myRange<double>(180-dtheta/2, -dtheta));
+      /* We want equal spacing/width in theta (I guess) so
+       * create cosbin here with this in mind. */
+      cosbin.push_back(-1.1);
+      for (size_t j=0; j < bin_list.size()-1; ++j) {
+        cosbin.push_back(cos(0.5*(bin_list[j]+bin_list[j+1])*M_PI/180));
+      }
+      cosbin.push_back(1.1);
+    }
+
+    /* Convert bin_list to bin edges. Put the ends of the bins a little off
+     * the min and max values so we don't have to deal with the dot product
+     * numerically being a little too big or small.
+     */
+    if (cosbin.size() == 0) {
+      cosbin.push_back(-1.1);
+      for (size_t j=0; j < bin_list.size()-1; ++j) {
+        cosbin.push_back(0.5*(bin_list[j]+bin_list[j+1]));
+      }
+      cosbin.push_back(1.1);
+    }
+    return true;
+  }
+
+  /** Store a list of maps in pixel major order.
+   *  The values of all \a maps at a pixel are stored contiguously, so
+   *  \a fields[p*K+a] is the value of map \a a at pixel \a p where \a K
+   *  is the number of maps.  This way a single gather fetches all fields
+   *  at a pixel.  All the maps \b must have the same Nside and scheme.
+   */
+  template<typename TM>
+  void make_pixel_major (const std::vector<Healpix_Map<TM> >& maps,
+                         std::vector<TM>& fields)
+  {
+    size_t K = maps.size();
+    if (K == 0) {
+      fields.clear();
+      return;
+    }
+    size_t Npix = maps[0].Npix();
+    fields.resize (Npix*K);
+    for (size_t p=0; p < Npix; ++p) {
+      for (size_t a=0; a < K; ++a) fields[p*K+a] = maps[a][p];
+    }
+  }
+
+  /** The Legendre polynomials at \a x.
+   *  \a P[l] is set to \f$P_\ell(x)\f$ for \f$\ell\f$ up to one less
+   *  than the size of \a P.  The polynomials are generated with the
+   *  standard upward recurrence relation
+   *  \f[ \ell P_\ell(x) = (2\ell-1) x P_{\ell-1}(x)
+   *                        - (\ell-1) P_{\ell-2}(x) \f]
+   *  which is stable for \f$|x|\le1\f$.
+   */
+  void legendre_polynomials (double x, std::vector<double>& P)
+  {
+    if (P.size() > 0) P[0] = 1;
+    if (P.size() > 1) P[1] = x;
+    for (size_t l=2; l < P.size(); ++l) {
+      P[l] = ((2*l-1)*x*P[l-1] - (l-1)*P[l-2]) / l;
+    }
+  }
+
+  /** Sum a Legendre series.
+   *  Calculate
+   *  \f[ \sum_{\ell=0}^{\ell_{\rm max}} a_\ell P_\ell(x) \f]
+   *  where \f$\ell_{\rm max}\f$ is one less than the size of \a coeff.
+   *  See legendre_polynomials().
+   */
+  double legendre_series (const std::vector<double>& coeff, double x)
+  {
+    std::vector<double> P (coeff.size());
+    legendre_polynomials (x, P);
+    double sum = 0;
+    for (size_t l=0; l < coeff.size(); ++l) sum += coeff[l] * P[l];
+    return sum;
+  }
 }
 
 #endif
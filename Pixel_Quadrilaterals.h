@@ -3,11 +3,13 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <tr1/memory> // For std::tr1::shared_ptr
 
 #include <Pixel_Triangles.h>
+#include <Pixel_Symmetry_Tables.h>
 #include <healpix_base.h>
 
-#include <pixel_ringinfo.h>
 #include <pixel_tools.h>
 
 namespace {
@@ -18,6 +20,103 @@ namespace {
 }
 
 namespace Npoint_Functions {
+  /** Index of triangles by their edges.
+   *
+   *  For every edge, the pair of pixels a < b, the third pixels of all
+   *  the triangles containing that edge are stored in increasing order
+   *  along with the orientation of the triangle.  The index is stored in
+   *  compressed row form, one row per pixel a, so the triangles sharing
+   *  an edge are found with a short search instead of scanning the
+   *  triangle list.  Once built the index is only read so it can be
+   *  shared between threads.
+   */
+  template<typename T>
+  class Triangle_Edge_Index {
+  public :
+    /// One triangle containing an edge.
+    struct Entry {
+      T b; // Second (larger) pixel of the edge.
+      T c; // Third pixel of the triangle.
+      bool righthanded; // Orientation of the triangle, pixels sorted.
+      inline bool operator< (const Entry& e) const
+      { return ((b < e.b) || ((b == e.b) && (c < e.c))); }
+    };
+  private :
+    std::vector<size_t> offset; // Start of the row for each pixel a.
+    std::vector<Entry> entries;
+
+    struct Less_b {
+      inline bool operator() (const Entry& e, T b) const { return e.b < b; }
+      inline bool operator() (T b, const Entry& e) const { return b < e.b; }
+    };
+    struct Less_c {
+      inline bool operator() (const Entry& e, T c) const { return e.c < c; }
+    };
+  public :
+    Triangle_Edge_Index () : offset(), entries() {}
+
+    /** Build the index.
+     *  The pixels in each triangle must be in increasing order, as they
+     *  are for Pixel_Triangles_Equilateral.  It is best to call
+     *  Pixel_Triangles::calculate_orientations() first.
+     */
+    void build (const Pixel_Triangles<T>& tri)
+    {
+      size_t Npix = 12 * static_cast<size_t>(tri.Nside())
+        * static_cast<size_t>(tri.Nside());
+      offset.assign (Npix+1, 0);
+      for (size_t j=0; j < tri.size(); ++j) {
+        const T *p = tri.get(j);
+        ++offset[p[0]+1];
+        ++offset[p[0]+1];
+        ++offset[p[1]+1];
+      }
+      for (size_t i=0; i < Npix; ++i) offset[i+1] += offset[i];
+      entries.resize (offset[Npix]);
+      std::vector<size_t> pos (offset.begin(), offset.end()-1);
+      Entry e;
+      for (size_t j=0; j < tri.size(); ++j) {
+        const T *p = tri.get(j);
+        e.righthanded = (tri.orientation(j) == RIGHTHANDED);
+        e.b = p[1]; e.c = p[2]; entries[pos[p[0]]++] = e;
+        e.b = p[2]; e.c = p[1]; entries[pos[p[0]]++] = e;
+        e.b = p[2]; e.c = p[0]; entries[pos[p[1]]++] = e;
+      }
+#pragma omp parallel for schedule(dynamic,1024) shared(Npix)
+      for (size_t i=0; i < Npix; ++i) {
+        std::sort (entries.begin()+offset[i], entries.begin()+offset[i+1]);
+      }
+    }
+
+    /** The triangles containing the edge \a a < \a b.
+     *  On return [\a begin, \a end) are the entries for the edge sorted
+     *  by the third pixel.
+     */
+    inline void find (T a, T b, const Entry*& begin, const Entry*& end) const
+    {
+      if (entries.size() == 0) {
+        begin = end = 0;
+        return;
+      }
+      std::pair<const Entry*, const Entry*> r
+        = std::equal_range (&entries[0]+offset[a], &entries[0]+offset[a+1],
+                            b, Less_b());
+      begin = r.first;
+      end = r.second;
+    }
+
+    /** Find the triangle \a a < \a b < \a c.
+     *  The entry for it is returned, or 0 if it is not in the index.
+     */
+    inline const Entry* find (T a, T b, T c) const
+    {
+      const Entry *begin, *end;
+      find (a, b, begin, end);
+      const Entry *e = std::lower_bound (begin, end, c, Less_c());
+      return (((e != end) && (e->c == c)) ? e : 0);
+    }
+  };
+
   /** Rhombic quadrilaterals.
    *
    *  Rhombic quadrilaterals are constructed from two equilateral triangles
@@ -29,6 +128,10 @@ namespace Npoint_Functions {
    *  Even with this specialization the quad table can be huge.  For this
    *  reason we create a class that incrementally calculates sets of points.
    *  This costs more in overhead but requires significantly less memory.
+   *
+   *  The triangles sharing an edge are found with a Triangle_Edge_Index.
+   *  The index is shared by all copies of the class, so a copy per
+   *  thread is cheap.
    */
   template<typename T>
   class Pixel_Quadrilaterals_Rhombic {
@@ -36,10 +139,51 @@ namespace Npoint_Functions {
     size_t ind_curr;
     T pixval_end;
     Pixel_Triangles_Equilateral<T> *t;
-    std::vector<size_t> skiplist;
+    std::tr1::shared_ptr<const Triangle_Edge_Index<T> > edges;
+
+    /* Is the triangle with third point c on the edge a < b on the other
+     * side of the edge from the triangle with third point w?  The
+     * orientations are for the triangles with their pixels sorted, so
+     * they flip when the third point is between the two edge pixels. */
+    static inline bool opposite (T a, T b, T w, bool w_righthanded,
+                                 T c, bool c_righthanded)
+    {
+      bool w_side = (w_righthanded != ((a < w) && (w < b)));
+      bool c_side = (c_righthanded != ((a < c) && (c < b)));
+      return (w_side != c_side);
+    }
+
+    /* Append the third points of the triangles across the edge a < b from
+     * the triangle with third point w.  Only triangles after the current
+     * one in pixel order, those with third point larger than cmin, are
+     * used. */
+    inline void add_across (T a, T b, T w, bool w_righthanded, T cmin,
+                            std::vector<T>& thirdpt) const
+    {
+      const typename Triangle_Edge_Index<T>::Entry *e, *end;
+      edges->find (a, b, e, end);
+      for (; e != end; ++e) {
+        if ((e->c > cmin) && opposite (a, b, w, w_righthanded,
+                                       e->c, e->righthanded)) {
+          thirdpt.push_back (e->c);
+        }
+      }
+    }
+
+    /* Is the triangle across the edge a < b from the one with third point
+     * w, with third point x, in the index and larger than cmin? */
+    inline bool is_across (T a, T b, T w, bool w_righthanded, T cmin,
+                           T x) const
+    {
+      if (x <= cmin) return false;
+      const typename Triangle_Edge_Index<T>::Entry *e
+        = edges->find (a, b, x);
+      return ((e != 0) && opposite (a, b, w, w_righthanded,
+                                    x, e->righthanded));
+    }
   public :  
     Pixel_Quadrilaterals_Rhombic () : ind_curr(0), pixval_end(0),
-                                      t(0), skiplist() {}
+                                      t(0), edges() {}
     /// \name Initialize Search
     //@{
     /** Initialize the rhombic quadrilateral search with a triangle.
@@ -50,30 +194,11 @@ namespace Npoint_Functions {
                      T pixel_value=-1)
     { 
       ind_curr = 0; t = &triangle;
-      /* Create the skip list. Since the actual pixel numbers are stored in
-       * triangle the skip list is indexed by pixel number at the relevant
-       * Nside. */
-      skiplist.assign (12*triangle.Nside()*triangle.Nside(), 0);
-      if (triangle.size() == 0) return;
-      T prev = triangle.get(0,0);
-      for (size_t j=1; j < triangle.size(); ++j) {
-        if (triangle.get(j,0) != prev) {
-          prev = triangle.get(j,0);
-          skiplist[prev] = j;
-        }
-      }
-      /* There can be 0 in the skip list if pixels do not appear in
-       * triangles, so we go through the list again, backwards and fill in
-       * the zeros.  The beginning of the list can have zeros so find
-       * the first non-zero value.  Also, if the end of the list has zeros
-       * we want to fill them in with the max value. */
-      size_t ind_start = 1; // [0] must be 0!
-      while (skiplist[ind_start] == 0) ++ind_start;
-      if (skiplist[skiplist.size()-1] == 0) 
-        skiplist[skiplist.size()-1] = triangle.size();
-      for (size_t ind=skiplist.size()-2; ind > ind_start; --ind) {
-        if (skiplist[ind] == 0) skiplist[ind] = skiplist[ind+1];
-      }
+      // Done here, before any threads share the triangles.
+      triangle.calculate_orientations();
+      Triangle_Edge_Index<T> *e = new Triangle_Edge_Index<T>;
+      e->build (triangle);
+      edges.reset (e);
 
       initialize (pixel_value);
     }
@@ -84,9 +209,16 @@ namespace Npoint_Functions {
     {
       if (pixel_value < 0) {
         ind_curr = 0;
-        pixval_end = skiplist.size();
+        pixval_end = 12*t->Nside()*t->Nside();
       } else {
-        ind_curr = skiplist[pixel_value];
+        // First triangle starting with pixel_value.
+        size_t lo = 0, hi = t->size();
+        while (lo < hi) {
+          size_t mid = lo + (hi-lo)/2;
+          if (t->get(mid,0) < pixel_value) lo = mid+1;
+          else hi = mid;
+        }
+        ind_curr = lo;
         pixval_end = pixel_value;
       }
     }
@@ -98,8 +230,28 @@ namespace Npoint_Functions {
     inline size_t Nside() const { return t->Nside(); }
     /** HEALPix ordering scheme of the pixels in the quadrilaterals. */
     inline Healpix_Ordering_Scheme Scheme() const { return t->Scheme(); }
+    /** The edge index of the triangles. */
+    inline const Triangle_Edge_Index<T>& edge_index() const
+    { return *edges; }
     //@}
 
+    /** Does next() list \a x as a third point for the triangle \a pts?
+     *  The pixels in \a pts must be in increasing order.  This is the
+     *  same test next() performs but for a single point.  Each rhombus is
+     *  only found from the smaller, in pixel order, of its two triangles
+     *  so \a x is listed only when the other triangle is the larger one.
+     */
+    bool lists (const T pts[3], T x) const
+    {
+      const typename Triangle_Edge_Index<T>::Entry *e
+        = edges->find (pts[0], pts[1], pts[2]);
+      if (e == 0) return false;
+      bool rh = e->righthanded;
+      return (is_across (pts[0], pts[1], pts[2], rh, pts[2], x)
+              || is_across (pts[0], pts[2], pts[1], rh, pts[1], x)
+              || is_across (pts[1], pts[2], pts[0], rh, pts[0], x));
+    }
+
     /** Get the next set of rhombic quadrilaterals.
      *  The quadrilaterals are constructed for each triangle provided to
      *  initialize(). The quadrilaterals are then made up of the three
@@ -121,94 +273,273 @@ namespace Npoint_Functions {
       thirdpt.clear();
       pts.resize(3);
       // Points are not ordered in any special way.
-      std::copy (t->get(ind_curr).begin(), t->get(ind_curr).end(),
-                 pts.begin());
-      // Shorthand
-      Npoint_Functions::Orientation o = t->orientation(ind_curr);
-      size_t j = ind_curr+1;
-      // First loop over triangles with the first two points equal
-      while ((j < t->size())
-             && (t->get(j,1) == pts[1])
-             && (t->get(j,0) == pts[0])) {
-        if (o != t->orientation(j)) {
-          thirdpt.push_back (t->get(j,2));
-        }
-        ++j;
-      }
-      /* Next loop over triangles looking for the case when the first and
-       * third points are equal to the first and third points of our base
-       * triangle. */
-      while ((j < t->size())
-             && (t->get(j,1) < pts[2])
-             && (t->get(j,0) == pts[0])) {
-        if ((o != t->orientation(j)) && (t->get(j,2) == pts[2])) {
-          thirdpt.push_back (t->get(j,1));
-        }
-        ++j;
+      std::copy (t->get(ind_curr), t->get(ind_curr)+3, pts.begin());
+      bool rh = (t->orientation(ind_curr) == RIGHTHANDED);
+      /* Look at the triangles across each edge.  Only those after this
+       * one in the sorted triangle list are used so each rhombus is
+       * found once, from its smaller triangle. */
+      add_across (pts[0], pts[1], pts[2], rh, pts[2], thirdpt);
+      add_across (pts[0], pts[2], pts[1], rh, pts[1], thirdpt);
+      add_across (pts[1], pts[2], pts[0], rh, pts[0], thirdpt);
+      ++ind_curr;
+      return true;
+    }
+  };
+
+  /** Base pixel information for the rhombic quadrilateral searches.
+   *  The pixels searched by the parallel quadrilateral finders are taken
+   *  from base pixels 0 and 4 since the symmetries that are applied to
+   *  the quadrilaterals differ between the two, see
+   *  Rhombic_Symmetry_Images.
+   */
+  struct PixelInfo {
+    enum BasePix { BASE0, BASE4} basepix;
+    int pixnum;
+  };
+
+  /** The pixels to search for rhombic quadrilaterals.
+   *  All pixels in base pixels 0 and 4 are stored along with which base
+   *  pixel they came from.
+   */
+  inline void rhombic_pixel_list (size_t Nside,
+                                  std::vector<PixelInfo>& pixel_list)
+  {
+    std::vector<int> pl0, pl4;
+    myHealpix::base0_list (Nside, pl0);
+    myHealpix::base4_list (Nside, pl4);
+    pixel_list.resize(pl0.size()+pl4.size());
+    for (size_t j=0; j < pl0.size(); ++j) {
+      pixel_list[j].pixnum = pl0[j];
+      pixel_list[j].basepix = PixelInfo::BASE0;
+    }
+    for (size_t j=0; j < pl4.size(); ++j) {
+      pixel_list[j+pl0.size()].pixnum = pl4[j];
+      pixel_list[j+pl0.size()].basepix = PixelInfo::BASE4;
+    }
+  }
+
+  /** Transform pixels by the symmetries of the HEALPix grid.
+   *  The transformations are lookups in the shared tables from
+   *  Pixel_Symmetry_Tables, so copies are cheap and may be shared
+   *  between threads.
+   */
+  class PixelTrans {
+  private :
+    const int *perm;
+    size_t Npix;
+  public :
+    PixelTrans () : perm(0), Npix(0) {}
+    PixelTrans (size_t Nside, Healpix_Ordering_Scheme scheme)
+      : perm(Pixel_Symmetry_Tables::get (Nside, scheme)),
+        Npix(12*Nside*Nside) {}
+
+    /** Apply symmetry \a k to all pixels.
+     *  See Pixel_Symmetry_Tables for the numbering of the symmetries.
+     */
+    template<typename T>
+    inline void transform (int k, std::vector<T>& pl) const
+    {
+      const int *P = perm + k*Npix;
+      for (size_t j=0; j < pl.size(); ++j) pl[j] = P[pl[j]];
+    }
+
+    /** Apply symmetry \a k to all pixels of \a in, storing them in
+     *  \a out. */
+    template<typename T>
+    inline void transform (int k, const std::vector<T>& in,
+                           std::vector<T>& out) const
+    {
+      const int *P = perm + k*Npix;
+      out.resize (in.size());
+      for (size_t j=0; j < in.size(); ++j) out[j] = P[in[j]];
+    }
+
+    /// Shift all pixels by one base pixel.
+    template<typename T>
+    inline void shift_by_base (std::vector<T>& pl) const
+    { transform (Pixel_Symmetry_Tables::SHIFT, pl); }
+
+    /// Reflect all pixels through the z-axis.
+    template<typename T>
+    inline void reflect_through_zaxis (std::vector<T>& pl) const
+    { transform (Pixel_Symmetry_Tables::REFLECT_ZAXIS, pl); }
+
+    /// Reflect all pixels through the z=0 plane.
+    template<typename T>
+    inline void reflect_through_z0 (std::vector<T>& pl) const
+    { transform (Pixel_Symmetry_Tables::REFLECT_Z0, pl); }
+  };
+
+  /** The base pixel of each pixel in the rhombic quadrilateral search.
+   *  Entry \a p of \a pixel_base is 1 if pixel \a p is in base pixel 0
+   *  and 2 if it is in base pixel 4 in \a pixel_list, see
+   *  rhombic_pixel_list(), and 0 otherwise.
+   */
+  inline void rhombic_pixel_base (size_t Nside,
+                                  const std::vector<PixelInfo>& pixel_list,
+                                  std::vector<char>& pixel_base)
+  {
+    pixel_base.assign (12*Nside*Nside, 0);
+    for (size_t j=0; j < pixel_list.size(); ++j) {
+      pixel_base[pixel_list[j].pixnum]
+        = ((pixel_list[j].basepix == PixelInfo::BASE0) ? 1 : 2);
+    }
+  }
+
+  /** Canonical images of rhombic quadrilaterals under the HEALPix
+   *  symmetries.
+   *
+   *  The quadrilaterals found from the pixels in base pixels 0 and 4, see
+   *  rhombic_pixel_list(), are mapped to the whole sky by the symmetries
+   *  of the grid, 8 images for base pixel 0 and 16 for base pixel 4.  Many
+   *  of these are the same quadrilateral reached from another pixel,
+   *  another symmetry, or another pair of triangles when more than one
+   *  diagonal has the length of the sides.  Only one representative of
+   *  each is passed on.
+   *
+   *  The search finds a quadrilateral (pixels sorted) from one of its
+   *  triangles (pixels sorted).  These pairs are ordered by the
+   *  quadrilateral and then the triangle.  An image is kept only if no
+   *  smaller pair in the orbit of the quadrilateral under all 16
+   *  symmetries is found by the search and mapped onto the image by one
+   *  of the symmetries allowed for its base pixel, and no earlier
+   *  symmetry of the same pair gives the same image.  Whether a pair is
+   *  found is decided from the triangle list itself, see
+   *  Pixel_Quadrilaterals_Rhombic::lists(), so every quadrilateral is
+   *  passed on exactly once.
+   */
+  template<typename T>
+  class Rhombic_Symmetry_Images {
+  private :
+    static const int Nimage = 16;
+    const Pixel_Quadrilaterals_Rhombic<T>& q;
+    const std::vector<char>& base;
+    PixelTrans pixtrans;
+    std::vector<T> tri_img[Nimage], x_img[Nimage];
+    std::vector<char> keep; // Nimage x number of third points.
+    std::vector<T> x_out;
+    T quad[Nimage][4];
+
+    // Images 8 and up include a reflection through the z-axis.
+    static inline int parity (int k) { return ((k < 8) ? 0 : 1); }
+
+    static inline void sort4 (T p[4])
+    {
+      if (p[0] > p[1]) std::swap (p[0], p[1]);
+      if (p[2] > p[3]) std::swap (p[2], p[3]);
+      if (p[0] > p[2]) std::swap (p[0], p[2]);
+      if (p[1] > p[3]) std::swap (p[1], p[3]);
+      if (p[1] > p[2]) std::swap (p[1], p[2]);
+    }
+
+    // -1, 0, 1 for a < b, a == b, a > b.
+    static inline int compare (const T *a, const T *b, int N)
+    {
+      for (int k=0; k < N; ++k) {
+        if (a[k] != b[k]) return ((a[k] < b[k]) ? -1 : 1);
       }
-      /* Next skip to triangles where the first and third points are equal
-       * to the first and second points of our base triangle. */
-      while ((j < t->size())
-             && (t->get(j,1) < pts[2])
-             && (t->get(j,0) == pts[0])) ++j;
-      // Now loop over these triangles.
-      while ((j < t->size())
-             && (t->get(j,1) == pts[2])
-             && (t->get(j,0) == pts[0])) {
-        if (o == t->orientation(j)) {
-          thirdpt.push_back (t->get(j,2));
-        }
-        ++j;
+      return 0;
+    }
+
+    /* All images of the triangle and third points.  Image k is symmetry
+     * k of Pixel_Symmetry_Tables, so the first 8 are the shifts by a
+     * base pixel and reflection through z=0, the next 8 are the same
+     * after a reflection through the z-axis. */
+    void find_images (const std::vector<T>& tri,
+                      const std::vector<T>& thirdpt)
+    {
+      for (int k=0; k < Nimage; ++k) {
+        pixtrans.transform (k, tri, tri_img[k]);
+        pixtrans.transform (k, thirdpt, x_img[k]);
       }
-      /* Next look for triangles with the second and third points equal to
-       * the second and third points of our base triangle. Unfortunately I
-       * don't know of a smarter way to do this. */
-      T prev;
-      while ((j < t->size()) && (t->get(j,0) < pts[1])) {
-        prev = t->get(j,0);
-        /* For the given value of the first point skip triangles until we
-         * get to one where the second point can possibly match the second
-         * point of the base triangle. */
-        while ((j < t->size()) 
-               && (t->get(j,1) < pts[1])
-               && (t->get(j,0) == prev)) ++j;
-        /* Now loop over the triangles where the second point matches. */
-        while ((j < t->size()) && (t->get(j,1) == pts[1])
-               && (t->get(j,0) == prev)) {
-          if ((o != t->orientation(j)) && 
-              (t->get(j,2) == pts[2])) {
-            thirdpt.push_back(t->get(j,0));
+    }
+
+    /* Which parities of symmetries are blocked for the images of the
+     * quadrilateral in quad[] found from triangle tri. */
+    void find_blocked (const T tri[3], bool blocked[2])
+    {
+      blocked[0] = blocked[1] = false;
+      for (int k=0; (k < Nimage) && (! (blocked[0] && blocked[1])); ++k) {
+        int c = compare (quad[k], quad[0], 4);
+        if (c > 0) continue;
+        // Each distinct quadrilateral only needs checking once.
+        bool seen = false;
+        for (int k2=0; (k2 < k) && (! seen); ++k2)
+          seen = (compare (quad[k2], quad[k], 4) == 0);
+        if (seen) continue;
+        for (int m=0; m < 4; ++m) {
+          T t2[3];
+          for (int i=0, n=0; i < 4; ++i) if (i != m) t2[n++] = quad[k][i];
+          if ((c == 0) && (compare (t2, tri, 3) >= 0)) continue;
+          char b = base[t2[0]];
+          if ((b == 0) || (! q.lists (t2, quad[k][m]))) continue;
+          if (b == 2) {
+            // Every symmetry is applied to base pixel 4.
+            blocked[0] = blocked[1] = true;
+            break;
+          }
+          for (int k2=0; k2 < Nimage; ++k2) {
+            if (compare (quad[k2], quad[k], 4) == 0)
+              blocked[parity(k2)] = true;
           }
-          ++j;
         }
-        /* Now skip the rest of the triangles where the first point
-         * matches. */
-        while ((j < t->size()) && (t->get(j,0) == prev)) ++j;
       }
-      /* Now loop over the triangles while its second point is less
-       * than the third point of our base triangle. Look for triangles in
-       * which the third point equals the third point of our base
-       * triangle. */
-      while ((j < t->size()) 
-             && (t->get(j,1) < pts[2])
-             && (t->get(j,0) == pts[1])) {
-        if ((o == t->orientation(j)) && (t->get(j,2) == pts[2])) {
-          thirdpt.push_back (t->get(j,1));
+    }
+  public :
+    /** Constructor.
+     *  The quadrilaterals are found by \a quads and \a pixel_base is
+     *  from rhombic_pixel_base().  Both must exist as long as this
+     *  does.  Each thread needs its own since the images are stored
+     *  internally.
+     */
+    Rhombic_Symmetry_Images (const Pixel_Quadrilaterals_Rhombic<T>& quads,
+                             const std::vector<char>& pixel_base)
+      : q(quads), base(pixel_base), pixtrans(quads.Nside(), quads.Scheme()),
+        keep(), x_out() {}
+
+    /** Pass on the canonical images of a set of quadrilaterals.
+     *  The quadrilaterals made from the triangle \a tri and each of the
+     *  third points \a thirdpt, as returned by
+     *  Pixel_Quadrilaterals_Rhombic::next() for a pixel in base pixel \a
+     *  basepix, are mapped by the symmetries of the grid.  For each image
+     *  \a f(tri_image, thirdpt_image) is called with only the third
+     *  points whose quadrilaterals are canonical, images with none are
+     *  skipped.
+     */
+    template<typename F>
+    void operator() (PixelInfo::BasePix basepix, const std::vector<T>& tri,
+                     const std::vector<T>& thirdpt, F& f)
+    {
+      int Ng = ((basepix == PixelInfo::BASE0) ? 8 : Nimage);
+      size_t N = thirdpt.size();
+      find_images (tri, thirdpt);
+      keep.assign (Nimage*N, 0);
+      for (size_t j=0; j < N; ++j) {
+        // A repeated third point gives the same quadrilaterals.
+        if (std::find (thirdpt.begin(), thirdpt.begin()+j, thirdpt[j])
+            != thirdpt.begin()+j) continue;
+        for (int k=0; k < Nimage; ++k) {
+          std::copy (tri_img[k].begin(), tri_img[k].end(), quad[k]);
+          quad[k][3] = x_img[k][j];
+          sort4 (quad[k]);
+        }
+        bool blocked[2];
+        find_blocked (&tri[0], blocked);
+        for (int g=0; g < Ng; ++g) {
+          if (blocked[parity(g)]) continue;
+          bool repeat = false;
+          for (int g2=0; (g2 < g) && (! repeat); ++g2)
+            repeat = (compare (quad[g2], quad[g], 4) == 0);
+          if (! repeat) keep[g*N+j] = 1;
         }
-        ++j;
       }
-      /* Finally loop over the triangles where the first and second points
-       * are equal to the second and third points of our base triangle. */
-      while ((j < t->size()) 
-             && (t->get(j,1) == pts[2])
-             && (t->get(j,0) == pts[1])) {
-        if (o != t->orientation(j)) {
-          thirdpt.push_back (t->get(j,2));
+      for (int g=0; g < Ng; ++g) {
+        x_out.clear();
+        for (size_t j=0; j < N; ++j) {
+          if (keep[g*N+j]) x_out.push_back (x_img[g][j]);
         }
-        ++j;
+        if (x_out.size() > 0) f (tri_img[g], x_out);
       }
-      ++ind_curr;
-      return true;
     }
   };
 
@@ -227,10 +558,8 @@ namespace Npoint_Functions {
   class Pixel_Quadrilaterals_Rhombic_Full 
     : public Pixel_Quadrilaterals_Rhombic<T> {
   private :
-    // So we don't need to keep recreating it.
-    myHealpix::pixel_ringinfo pri;
-    // NEED Healpix_Base unless triangle is already in ring scheme
-    Healpix_Base HBase;
+    // Symmetries of the grid.
+    PixelTrans pixtrans;
     // Simple state engine information
     // The base pixel on which we are working.
     enum BasePix { BASE0, BASE4} basepix;
@@ -248,45 +577,10 @@ namespace Npoint_Functions {
     std::vector<T> pixlist;
     size_t ind_curr;
 
-    // Wrappers to handle the scheme for our pixels.
-    inline void _pri_setpix (T p)
-    {
-      if (HBase.Scheme() == NEST) {
-        pri.from_pixel (HBase.nest2ring(p));
-      } else {
-        pri.from_pixel (p);
-      }
-    }
-    inline T _pri_frompix () const {
-      if (HBase.Scheme() == NEST) {
-        return HBase.ring2nest(pri.to_pixel());
-      } else {
-        return pri.to_pixel();
-      }
-    }
-    inline T _shift_pix (T p)
-    {
-      _pri_setpix (p);
-      pri.shift_by_base_pixel();
-      return _pri_frompix();
-    }      
-    inline T _reflect_zaxis (T p)
-    {
-      _pri_setpix (p);
-      pri.reflect_through_zaxis();
-      return _pri_frompix();
-    }
-    inline T _reflect_z0 (T p)
-    {
-      _pri_setpix (p);
-      pri.reflect_through_z0();
-      return _pri_frompix();
-    }
-
   public :
     Pixel_Quadrilaterals_Rhombic_Full () :
       /// Constructor.
-      Pixel_Quadrilaterals_Rhombic<T>(), pri(), HBase(),
+      Pixel_Quadrilaterals_Rhombic<T>(), pixtrans(),
       basepix(BASE0), operation(FINDQUADS), optcount(0),
       pts_saved(3), thirdpt_saved(), pts_latest(3), thirdpt_latest(),
       pixlist(), ind_curr(0) {}
@@ -303,8 +597,7 @@ namespace Npoint_Functions {
       operation = FINDQUADS;
       optcount = 0;
       ind_curr = 0;
-      pri.Nside = triangle.Nside();
-      HBase.SetNside (triangle.Nside(), triangle.Scheme());
+      pixtrans = PixelTrans (triangle.Nside(), triangle.Scheme());
     }
 
     /** Find the next set of quadrilaterals.
@@ -318,10 +611,8 @@ namespace Npoint_Functions {
     {
       // This is a complicated beast!
       if (operation == SHIFT) {
-        for (size_t j=0; j < pts_latest.size(); ++j)
-          pts_latest[j] = _shift_pix (pts_latest[j]);
-        for (size_t j=0; j < thirdpt_latest.size(); ++j)
-          thirdpt_latest[j] = _shift_pix (thirdpt_latest[j]);
+        pixtrans.shift_by_base (pts_latest);
+        pixtrans.shift_by_base (thirdpt_latest);
         if (optcount == 4) operation = REFLECT1;
         else if (optcount == 8) {
           if (basepix == BASE0) {
@@ -367,31 +658,24 @@ namespace Npoint_Functions {
         optcount = 1;
       } else if (operation == REFLECT1) {
         // Reflect through z=0 line
-        for (size_t j=0; j < pts_latest.size(); ++j)
-          pts_latest[j] = _reflect_z0 (pts_saved[j]);
-        for (size_t j=0; j < thirdpt_latest.size(); ++j)
-          thirdpt_latest[j] = _reflect_z0 (thirdpt_saved[j]);
+        pixtrans.transform (Pixel_Symmetry_Tables::REFLECT_Z0,
+                            pts_saved, pts_latest);
+        pixtrans.transform (Pixel_Symmetry_Tables::REFLECT_Z0,
+                            thirdpt_saved, thirdpt_latest);
         operation = SHIFT;
       } else if (operation == REFLECT2) {
         // Reflect through z-axis
-        for (size_t j=0; j < pts_latest.size(); ++j)
-          pts_latest[j] = _reflect_zaxis (pts_saved[j]);
-        for (size_t j=0; j < thirdpt_latest.size(); ++j)
-          thirdpt_latest[j] = _reflect_zaxis (thirdpt_saved[j]);
+        pixtrans.transform (Pixel_Symmetry_Tables::REFLECT_ZAXIS,
+                            pts_saved, pts_latest);
+        pixtrans.transform (Pixel_Symmetry_Tables::REFLECT_ZAXIS,
+                            thirdpt_saved, thirdpt_latest);
         operation = SHIFT;
       } else if (operation == REFLECT3) {
-        /* Reflect through z=0 line and through the z-axis This could be
-         *  further optimized. */
-        // z-axis
-        for (size_t j=0; j < pts_latest.size(); ++j)
-          pts_latest[j] = _reflect_zaxis (pts_saved[j]);
-        for (size_t j=0; j < thirdpt_latest.size(); ++j)
-          thirdpt_latest[j] = _reflect_zaxis (thirdpt_saved[j]);
-        // z=0
-        for (size_t j=0; j < pts_latest.size(); ++j)
-          pts_latest[j] = _reflect_z0 (pts_latest[j]);
-        for (size_t j=0; j < thirdpt_latest.size(); ++j)
-          thirdpt_latest[j] = _reflect_z0 (thirdpt_latest[j]);
+        // Reflect through the z-axis and then the z=0 line
+        const int k = (Pixel_Symmetry_Tables::REFLECT_ZAXIS
+                       + Pixel_Symmetry_Tables::REFLECT_Z0);
+        pixtrans.transform (k, pts_saved, pts_latest);
+        pixtrans.transform (k, thirdpt_saved, thirdpt_latest);
         operation = SHIFT;
       }
 
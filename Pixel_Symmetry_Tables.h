@@ -0,0 +1,161 @@
+#ifndef PIXEL_SYMMETRY_TABLES_H
+#define PIXEL_SYMMETRY_TABLES_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <tr1/memory> // For std::tr1::shared_ptr
+
+#include <healpix_base.h>
+
+#include <pixel_ringinfo.h>
+
+namespace {
+  /// @cond IDTAG
+  const std::string PIXEL_SYMMETRY_TABLES_RCSID
+  ("$Id$");
+  /// @endcond
+}
+
+namespace Npoint_Functions {
+  /** Process wide cache of the HEALPix grid symmetries as pixel
+   *  permutations.
+   *
+   *  The HEALPix grid is unchanged by shifting by a base pixel (rotating
+   *  by 90 degrees about the z-axis), reflecting through the z=0 plane,
+   *  and reflecting through the z-axis.  Together these give 16
+   *  symmetries.  Symmetry \a k = \a n + 4 \a b + 8 \a a first reflects
+   *  through the z-axis if \a a is 1, then through z=0 if \a b is 1, and
+   *  finally shifts by \a n base pixels.  So 1 is a single shift, 4 is
+   *  the reflection through z=0, 8 is the reflection through the z-axis,
+   *  and 0 through 7 are the symmetries without a reflection through the
+   *  z-axis.
+   *
+   *  Each symmetry is stored as a flat array giving the image of every
+   *  pixel so transforming a pixel is a single lookup.  The tables are
+   *  calculated once per Nside and scheme, in parallel, and shared read
+   *  only.  They are never freed.  Anything needing the symmetries, for
+   *  example the rhombic quadrilateral search or an estimator averaging a
+   *  map over them, should use these.
+   *
+   *  All access is done in a critical section so this is thread safe.
+   */
+  class Pixel_Symmetry_Tables {
+  public :
+    /// Number of symmetries.
+    enum { Nsymmetry = 16 };
+    /// \name Elementary symmetries
+    //@{
+    enum { SHIFT = 1, REFLECT_Z0 = 4, REFLECT_ZAXIS = 8 };
+    //@}
+  private :
+    typedef std::map<std::pair<size_t, int>,
+                     std::tr1::shared_ptr<std::vector<int> > > table_map;
+
+    static table_map& tables ()
+    {
+      static table_map t;
+      return t;
+    }
+
+    static void build (size_t Nside, Healpix_Ordering_Scheme scheme,
+                       std::vector<int>& perm)
+    {
+      size_t Npix = 12*Nside*Nside;
+      perm.resize (Nsymmetry*Npix);
+      int *P = &perm[0];
+      // First the elementary symmetries, straight from the ring info.
+#pragma omp parallel shared(P, Nside, scheme, Npix)
+      {
+        myHealpix::pixel_ringinfo pri (Nside);
+        Healpix_Base HBase (Nside, scheme, SET_NSIDE);
+#pragma omp for schedule(static)
+        for (size_t p=0; p < Npix; ++p) {
+          int r = ((scheme == NEST) ? HBase.nest2ring(p) : p);
+          int img[3];
+          pri.from_pixel (r);
+          pri.shift_by_base_pixel();
+          img[0] = pri.to_pixel();
+          pri.from_pixel (r);
+          pri.reflect_through_z0();
+          img[1] = pri.to_pixel();
+          pri.from_pixel (r);
+          pri.reflect_through_zaxis();
+          img[2] = pri.to_pixel();
+          for (int j=0; j < 3; ++j) {
+            if (scheme == NEST) img[j] = HBase.ring2nest (img[j]);
+          }
+          P[p] = static_cast<int>(p);
+          P[SHIFT*Npix+p] = img[0];
+          P[REFLECT_Z0*Npix+p] = img[1];
+          P[REFLECT_ZAXIS*Npix+p] = img[2];
+        }
+      }
+      // The rest are compositions of these.
+      const int *S = P + SHIFT*Npix;
+      const int *Z = P + REFLECT_Z0*Npix;
+      const int *A = P + REFLECT_ZAXIS*Npix;
+#pragma omp parallel for schedule(static) shared(P, S, Z, A, Npix)
+      for (size_t p=0; p < Npix; ++p) {
+        for (int a=0; a < 2; ++a) {
+          for (int b=0; b < 2; ++b) {
+            int x = ((a == 1) ? A[p] : static_cast<int>(p));
+            if (b == 1) x = Z[x];
+            for (int n=0; n < 4; ++n) {
+              P[(n+4*b+8*a)*Npix+p] = x;
+              x = S[x];
+            }
+          }
+        }
+      }
+    }
+  public :
+    /** The symmetry tables.
+     *  The returned array has Nsymmetry*12*Nside*Nside entries.  Entry
+     *  \a k*12*Nside*Nside+\a p is the image of pixel \a p under symmetry
+     *  \a k, in the \a scheme ordering.  It must not be freed.
+     */
+    static const int* get (size_t Nside, Healpix_Ordering_Scheme scheme)
+    {
+      std::pair<size_t, int> key (Nside, static_cast<int>(scheme));
+      std::tr1::shared_ptr<std::vector<int> > perm;
+#pragma omp critical(pixel_symmetry_tables)
+      {
+        table_map::iterator i = tables().find (key);
+        if (i != tables().end()) perm = i->second;
+      }
+      if (! perm) {
+        /* Built outside the critical section so it can be done in
+         * parallel.  If another thread got there first its copy is
+         * used. */
+        std::tr1::shared_ptr<std::vector<int> > p (new std::vector<int>);
+        build (Nside, scheme, *p);
+#pragma omp critical(pixel_symmetry_tables)
+        {
+          std::tr1::shared_ptr<std::vector<int> >& t = tables()[key];
+          if (! t) t = p;
+          perm = t;
+        }
+      }
+      return &(*perm)[0];
+    }
+  };
+
+  /** Permutation for HEALPix grid symmetry \a k.
+   *  Short hand for the part of Pixel_Symmetry_Tables::get() for one
+   *  symmetry, indexed by pixel.
+   */
+  inline const int* pixel_symmetry (size_t Nside,
+                                    Healpix_Ordering_Scheme scheme, int k)
+  {
+    return Pixel_Symmetry_Tables::get (Nside, scheme) + k*12*Nside*Nside;
+  }
+}
+
+#endif
+
+/* For emacs, this is a c++ header
+ * Local Variables:
+ * mode: c++
+ * End:
+ */
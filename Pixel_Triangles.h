@@ -3,10 +3,21 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <healpix_base.h>
+#include <healpix_map.h>
 #include <vec3.h>
 
+#include <Twopt_Table.h>
 #include <Npoint_Functions_Utils.h>
 
 namespace {
@@ -17,42 +28,197 @@ namespace {
 }
 
 namespace {
-    /** Find matches in two lists and append them to a new list. */
-  template<class IteratorType, typename T>
-  void append_matches (IteratorType it1, IteratorType it1end,
-                       IteratorType it2, IteratorType it2end,
-                       std::vector<T>& res)
+  /** Number of entries before the -1 padding of a sorted table row.
+   *  The padding is at the end so it is found by a binary search. */
+  template<typename T>
+  size_t padded_row_length (const T* first, const T* last)
   {
-    /* Loop over the iterators storing matches.
-     * Since the lists are monotonically increasing and -1 padded at the end
-     * a simple linear search is an efficient algorithm.
-     */
-    while ( (it1 != it1end) && (it2 != it2end)
-            && (*it1 != -1) && (*it2 != -1) ) {
-      if (*it1 == *it2) {
-        res.push_back (*it1);
-        ++it1;
-        ++it2;
-      } else if (*it1 < *it2) {
-        ++it1;
+    size_t lo = 0, hi = last - first, mid;
+    while (lo < hi) {
+      mid = lo + (hi-lo)/2;
+      if (first[mid] == -1) {
+        hi = mid;
       } else {
-        ++it2;
+        lo = mid + 1;
       }
     }
+    return lo;
+  }
+
+  /** Intersect two sorted lists by a simple linear merge. */
+  template<typename T>
+  void intersect_merge (const T* a, size_t na, const T* b, size_t nb,
+                        std::vector<T>& res)
+  {
+    size_t i=0, j=0;
+    while ((i < na) && (j < nb)) {
+      if (a[i] == b[j]) {
+        res.push_back (a[i]);
+        ++i;
+        ++j;
+      } else if (a[i] < b[j]) {
+        ++i;
+      } else {
+        ++j;
+      }
+    }
+  }
+
+#ifdef __SSE2__
+  /** Intersect two sorted int lists comparing blocks of four.
+   *  Each block of \a a is compared against all four rotations of the
+   *  current block of \a b and the block with the smaller last element is
+   *  advanced.  The values in each list must be unique.  The remainder is
+   *  finished with the linear merge. */
+  inline void intersect_merge (const int* a, size_t na,
+                               const int* b, size_t nb,
+                               std::vector<int>& res)
+  {
+    size_t i=0, j=0;
+    while ((i+4 <= na) && (j+4 <= nb)) {
+      __m128i va = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(a+i));
+      __m128i vb = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(b+j));
+      __m128i eq = _mm_cmpeq_epi32 (va, vb);
+      eq = _mm_or_si128 (eq, _mm_cmpeq_epi32
+                         (va, _mm_shuffle_epi32 (vb, _MM_SHUFFLE(0,3,2,1))));
+      eq = _mm_or_si128 (eq, _mm_cmpeq_epi32
+                         (va, _mm_shuffle_epi32 (vb, _MM_SHUFFLE(1,0,3,2))));
+      eq = _mm_or_si128 (eq, _mm_cmpeq_epi32
+                         (va, _mm_shuffle_epi32 (vb, _MM_SHUFFLE(2,1,0,3))));
+      int mask = _mm_movemask_ps (_mm_castsi128_ps (eq));
+      for (int k=0; mask != 0; ++k, mask >>= 1) {
+        if (mask & 1) res.push_back (a[i+k]);
+      }
+      int amax = a[i+3], bmax = b[j+3];
+      if (amax <= bmax) i += 4;
+      if (bmax <= amax) j += 4;
+    }
+    intersect_merge<int> (a+i, na-i, b+j, nb-j, res);
+  }
+#endif
+
+  /** Intersect a short sorted list with a much longer one.
+   *  Each element of \a a is located in \a b by an exponential search
+   *  from the previous position followed by a binary search. */
+  template<typename T>
+  void intersect_gallop (const T* a, size_t na, const T* b, size_t nb,
+                         std::vector<T>& res)
+  {
+    const T* bend = b + nb;
+    for (size_t i=0; (i < na) && (b != bend); ++i) {
+      size_t step = 1;
+      while ((step < static_cast<size_t>(bend-b)) && (b[step] < a[i]))
+        step *= 2;
+      b = std::lower_bound (b + step/2,
+                            b + std::min (step+1,
+                                          static_cast<size_t>(bend-b)),
+                            a[i]);
+      if ((b != bend) && (*b == a[i])) {
+        res.push_back (a[i]);
+        ++b;
+      }
+    }
+  }
+
+  /** Find matches in two sorted lists of unique values and append them to
+   *  a new list.  The algorithm is picked from the lengths of the lists:
+   *  a galloping search when one is much longer than the other, otherwise
+   *  a merge (comparing blocks of values with SSE2 when available). */
+  template<typename T>
+  void intersect_sorted (const T* a, size_t na, const T* b, size_t nb,
+                         std::vector<T>& res)
+  {
+    if (na > nb) {
+      std::swap (a, b);
+      std::swap (na, nb);
+    }
+    if (na == 0) return;
+    if (32*na < nb) {
+      intersect_gallop (a, na, b, nb, res);
+    } else {
+      intersect_merge (a, na, b, nb, res);
+    }
+  }
+
+  /** Find matches in two lists and append them to a new list.
+   *  The lists are table rows, monotonically increasing and -1 padded at
+   *  the end. */
+  template<typename T>
+  void append_matches (const T* it1, const T* it1end,
+                       const T* it2, const T* it2end,
+                       std::vector<T>& res)
+  {
+    intersect_sorted (it1, padded_row_length (it1, it1end),
+                      it2, padded_row_length (it2, it2end), res);
   }
   
   /* Find matches in two lists and append them to a new list.
    *  Here the minimum allowed value is provided.  All values appended to the
    *  list will be greater than or equal to this value. */
-  template<class IteratorType, typename T>
+  template<typename T>
   void append_matches (T minval,
-                       IteratorType it1, IteratorType it1end,
-                       IteratorType it2, IteratorType it2end,
+                       const T* it1, const T* it1end,
+                       const T* it2, const T* it2end,
                        std::vector<T>& res)
   {
-    while ((it1 != it1end) && (*it1 < minval)) ++it1;
-    while ((it2 != it2end) && (*it2 < minval)) ++it2;
-    append_matches (it1, it1end, it2, it2end, res);
+    it1end = it1 + padded_row_length (it1, it1end);
+    it2end = it2 + padded_row_length (it2, it2end);
+    it1 = std::lower_bound (it1, it1end, minval);
+    it2 = std::lower_bound (it2, it2end, minval);
+    intersect_sorted (it1, it1end-it1, it2, it2end-it2, res);
+  }
+
+  /** Index of the lowest set bit of a nonzero word. */
+  inline int lowest_set_bit (uint64_t w)
+  {
+#ifdef __GNUC__
+    return __builtin_ctzll (w);
+#else
+    int n = 0;
+    while (! (w & 1)) {
+      w >>= 1;
+      ++n;
+    }
+    return n;
+#endif
+  }
+
+  /** Find matches in two bitmap rows of \a Nw words and append them to a
+   *  new list.  Only values greater than or equal to \a minval are
+   *  appended. */
+  template<typename T>
+  void append_bitmap_matches (T minval, const uint64_t* a, const uint64_t* b,
+                              size_t Nw, std::vector<T>& res)
+  {
+    size_t k = minval/64;
+    if (k >= Nw) return;
+    uint64_t w = a[k] & b[k] & (~uint64_t(0) << (minval%64));
+    while (true) {
+      while (w != 0) {
+        res.push_back (static_cast<T>(64*k + lowest_set_bit (w)));
+        w &= w - 1;
+      }
+      if (++k == Nw) break;
+      w = a[k] & b[k];
+    }
+  }
+
+  /** Find matches in row \a i1 of \a t1 and row \a i2 of \a t2 and append
+   *  them to a new list.  The bitmaps are used when both tables have
+   *  them, otherwise append_matches().  Only values greater than or equal
+   *  to \a minval are appended. */
+  template<typename T>
+  void append_row_matches (const Npoint_Functions::Twopt_Table<T>& t1, T i1,
+                           const Npoint_Functions::Twopt_Table<T>& t2, T i2,
+                           std::vector<T>& res, T minval=0)
+  {
+    if (t1.has_bitmap() && t2.has_bitmap() && (t1.Npix() == t2.Npix())) {
+      append_bitmap_matches (minval, t1.bitmap_row(i1), t2.bitmap_row(i2),
+                             t1.bitmap_words(), res);
+    } else {
+      append_matches (minval, &t1(i1,0), &t1(i1,t1.Nmax()),
+                      &t2(i2,0), &t2(i2,t2.Nmax()), res);
+    }
   }
 }
 
@@ -76,23 +242,302 @@ namespace Npoint_Functions {
       return ((val > 0) ? RIGHTHANDED : LEFTHANDED);
     }
 
+  /** Visit all triangles.
+   *  Find all the triangles that can be made up from the two point tables
+   *  \a t1, \a t2, and \a t3 (see Pixel_Triangles::find_triangles())
+   *  without storing them.  For each pair of first and second vertices
+   *  with at least one third vertex the visitor is called as
+   *  \code vis (i1, i2, matches) \endcode
+   *  where \a matches is a std::vector<T> of the third vertices.  All
+   *  vertices are indices into the pixel list of the tables, so
+   *  t1.pixel_list(i1) is the pixel number.  The visitor can thus sum over
+   *  the third vertices before multiplying by the values at the first two
+   *  and no memory is used for the triangles.
+   *
+   *  Only first vertices \a i1begin <= i1 < \a i1end are visited so the
+   *  work may be split into ranges of rows.
+   *  \relates Pixel_Triangles
+   */
+  template<typename T, class Visitor>
+  void visit_triangles (const Twopt_Table<T>& t1,
+                        const Twopt_Table<T>& t2,
+                        const Twopt_Table<T>& t3,
+                        Visitor& vis, size_t i1begin=0,
+                        size_t i1end=static_cast<size_t>(-1))
+  {
+    T i2;
+    std::vector<T> trip;
+    i1end = std::min (i1end, t1.Npix());
+    for (size_t i1=i1begin; i1 < i1end; ++i1) {
+      for (size_t j2=0; (j2 < t1.Nmax()) && (t1(i1,j2) != -1); ++j2) {
+        i2 = t1(i1,j2);
+        trip.clear();
+        append_row_matches (t2, static_cast<T>(i1), t3, i2, trip);
+        if (trip.size() > 0) vis (static_cast<T>(i1), i2, trip);
+      }
+    }
+  }
+
+  /** Visit all isosceles triangles.
+   *  Same as visit_triangles() for the triangles found by
+   *  Pixel_Triangles_Isosceles::find_triangles().
+   *  \relates Pixel_Triangles_Isosceles
+   */
+  template<typename T, class Visitor>
+  void visit_isosceles_triangles (const Twopt_Table<T>& tequal,
+                                  const Twopt_Table<T>& tother,
+                                  Visitor& vis, size_t i1begin=0,
+                                  size_t i1end=static_cast<size_t>(-1))
+  {
+    T i2;
+    std::vector<T> trip;
+    i1end = std::min (i1end, tother.Npix());
+    for (size_t i1=i1begin; i1 < i1end; ++i1) {
+      T p1 = tother.pixel_list(i1);
+      for (size_t j2=0; (j2 < tother.Nmax()) && (tother(i1,j2) != -1);
+           ++j2) {
+        i2 = tother(i1,j2);
+        if (tother.pixel_list(i2) < p1) continue; // Don't double count.
+        trip.clear();
+        append_row_matches (tequal, static_cast<T>(i1), tequal, i2, trip);
+        if (trip.size() > 0) vis (static_cast<T>(i1), i2, trip);
+      }
+    }
+  }
+
+  /** Visit all equilateral triangles.
+   *  Same as visit_triangles() for the triangles found by
+   *  Pixel_Triangles_Equilateral::find_triangles().  The vertices are in
+   *  increasing order so every triangle is visited from exactly one row,
+   *  that of its smallest vertex.
+   *  \relates Pixel_Triangles_Equilateral
+   */
+  template<typename T, class Visitor>
+  void visit_equilateral_triangles (const Twopt_Table<T>& t, Visitor& vis,
+                                    size_t i1begin=0,
+                                    size_t i1end=static_cast<size_t>(-1))
+  {
+    T i2;
+    std::vector<T> trip;
+    i1end = std::min (i1end, t.Npix());
+    for (size_t i1=i1begin; i1 < i1end; ++i1) {
+      T p1 = t.pixel_list(i1);
+      for (size_t j2=0; (j2 < t.Nmax()) && (t(i1,j2) != -1); ++j2) {
+        i2 = t(i1,j2);
+        if (t.pixel_list(i2) < p1) continue;
+        trip.clear();
+        append_row_matches (t, static_cast<T>(i1), t, i2, trip, i2);
+        if (trip.size() > 0) vis (static_cast<T>(i1), i2, trip);
+      }
+    }
+  }
+
+  /** \name Triangle finders
+   *  Call a visitor for the triangles with first vertex in a range of
+   *  rows, \code finder (vis, i1begin, i1end) \endcode, see
+   *  visit_in_blocks().
+   *  \relates Pixel_Triangles
+   */
+  //@{
+  /// All triangles, see visit_triangles().
+  template<typename T>
+  struct Scalene_Finder {
+    const Twopt_Table<T> &t1, &t2, &t3;
+    Scalene_Finder (const Twopt_Table<T>& t1_, const Twopt_Table<T>& t2_,
+                    const Twopt_Table<T>& t3_)
+      : t1(t1_), t2(t2_), t3(t3_) {}
+    template<class Visitor>
+    void operator() (Visitor& vis, size_t i1begin, size_t i1end) const
+    { visit_triangles (t1, t2, t3, vis, i1begin, i1end); }
+  };
+  /// Isosceles triangles, see visit_isosceles_triangles().
+  template<typename T>
+  struct Isosceles_Finder {
+    const Twopt_Table<T> &tequal, &tother;
+    Isosceles_Finder (const Twopt_Table<T>& tequal_,
+                      const Twopt_Table<T>& tother_)
+      : tequal(tequal_), tother(tother_) {}
+    template<class Visitor>
+    void operator() (Visitor& vis, size_t i1begin, size_t i1end) const
+    { visit_isosceles_triangles (tequal, tother, vis, i1begin, i1end); }
+  };
+  /// Equilateral triangles, see visit_equilateral_triangles().
+  template<typename T>
+  struct Equilateral_Finder {
+    const Twopt_Table<T> &t;
+    Equilateral_Finder (const Twopt_Table<T>& t_) : t(t_) {}
+    template<class Visitor>
+    void operator() (Visitor& vis, size_t i1begin, size_t i1end) const
+    { visit_equilateral_triangles (t, vis, i1begin, i1end); }
+  };
+  //@}
+
+  /** True if \a Nbin bins are enough to keep all the threads busy.
+   *  Drivers looping over bins in parallel should otherwise run the loop
+   *  on one thread (an inactive parallel region) so each bin is split
+   *  over the threads by visit_in_blocks() or the triangle finders.
+   *  \relates Pixel_Triangles
+   */
+  inline bool parallel_over_bins (size_t Nbin)
+  {
+#ifdef OMP
+    return (Nbin >= static_cast<size_t>(omp_get_max_threads()));
+#else
+    return true;
+#endif
+  }
+
+  /** Visit the triangles in parallel blocks of rows.
+   *  The \a finder (see Scalene_Finder) is called for all first
+   *  vertices, the rows of \a table, accumulating into \a kernel.  When
+   *  not already running in parallel the rows are split into blocks
+   *  visited in parallel, each with its own copy of \a kernel, which are
+   *  then added to \a kernel in block order.  The kernel must provide
+   *  reset() and add() for another kernel, see Threepoint_Kernel.
+   *  \relates Pixel_Triangles
+   */
+  template<class Finder, typename T, class Kernel>
+  void visit_in_blocks (const Finder& finder, const Twopt_Table<T>& table,
+                        Kernel& kernel)
+  {
+    size_t Npix = table.Npix();
+#ifdef OMP
+    if ((! omp_in_parallel()) && (omp_get_max_threads() > 1)) {
+      // Many more blocks than threads to balance the load.
+      size_t Nblock = std::min (Npix, 16*static_cast<size_t>
+                                (omp_get_max_threads()));
+      std::vector<Kernel> kb (Nblock, kernel);
+#pragma omp parallel for schedule(dynamic,1) shared(kb, finder, Npix, Nblock)
+      for (size_t b=0; b < Nblock; ++b) {
+        kb[b].reset();
+        finder (kb[b], b*Npix/Nblock, (b+1)*Npix/Nblock);
+      }
+      for (size_t b=0; b < Nblock; ++b) kernel.add (kb[b]);
+      return;
+    }
+#endif
+    finder (kernel, 0, Npix);
+  }
+
+  /** Three point function kernel for the triangle visitors.
+   *  The product of the map values at the vertices is accumulated in
+   *  factorized form,
+   *  \f$ m_1 m_2 \sum_3 m_3 \f$, for each visit.  The map is indexed by
+   *  pixel number and \a table (any of the tables used to find the
+   *  triangles) converts indices to pixels.  It is \b assumed that the
+   *  scheme of the map is the same as that of the table.
+   *  \relates Pixel_Triangles
+   */
+  template<typename TM, typename T>
+  class Threepoint_Kernel {
+  private :
+    const Healpix_Map<TM>& map;
+    const Twopt_Table<T>& table;
+    TM C;
+    size_t N;
+  public :
+    Threepoint_Kernel (const Healpix_Map<TM>& map_,
+                       const Twopt_Table<T>& table_)
+      : map(map_), table(table_), C(0), N(0) {}
+    /// Zero the sums.
+    inline void reset () { C = 0; N = 0; }
+    /// Add the sums from \a k, see visit_in_blocks().
+    inline void add (const Threepoint_Kernel& k) { C += k.C; N += k.N; }
+    inline void operator() (T i1, T i2, const std::vector<T>& matches)
+    {
+      TM Csum = 0;
+      for (size_t k=0; k < matches.size(); ++k) {
+        Csum += map[table.pixel_list(matches[k])];
+      }
+      C += map[table.pixel_list(i1)] * map[table.pixel_list(i2)] * Csum;
+      N += matches.size();
+    }
+    /// \name Accessors
+    //@{
+    /// Sum of the products.
+    inline TM sum () const { return C; }
+    /// Number of triangles.
+    inline size_t count () const { return N; }
+    /// The three point function, zero if there are no triangles.
+    inline TM value () const { return ((N > 0) ? C/N : 0); }
+    //@}
+  };
+
+  /** Three point function kernel for a list of maps.
+   *  Same as Threepoint_Kernel but the three point function is
+   *  accumulated for \a K maps at once, so the triangles are only found
+   *  once for all of them.  The maps are stored in pixel major order as
+   *  created by make_pixel_major(), \a fields[p*K+a] is the value of map
+   *  \a a at pixel \a p.
+   *  \relates Pixel_Triangles
+   */
+  template<typename TM, typename T>
+  class Threepoint_List_Kernel {
+  private :
+    const std::vector<TM>& fields;
+    size_t K;
+    const Twopt_Table<T>& table;
+    std::vector<TM> C, Csum;
+    size_t N;
+  public :
+    Threepoint_List_Kernel (const std::vector<TM>& fields_, size_t K_,
+                            const Twopt_Table<T>& table_)
+      : fields(fields_), K(K_), table(table_), C(K_, 0), Csum(K_), N(0) {}
+    /// Zero the sums.
+    inline void reset () { std::fill (C.begin(), C.end(), 0); N = 0; }
+    /// Add the sums from \a k, see visit_in_blocks().
+    void add (const Threepoint_List_Kernel& k)
+    {
+      for (size_t a=0; a < K; ++a) C[a] += k.C[a];
+      N += k.N;
+    }
+    void operator() (T i1, T i2, const std::vector<T>& matches)
+    {
+      std::fill (Csum.begin(), Csum.end(), 0);
+      for (size_t k=0; k < matches.size(); ++k) {
+        const TM *f3 = &fields[table.pixel_list(matches[k])*K];
+        for (size_t a=0; a < K; ++a) Csum[a] += f3[a];
+      }
+      const TM *f1 = &fields[table.pixel_list(i1)*K];
+      const TM *f2 = &fields[table.pixel_list(i2)*K];
+      for (size_t a=0; a < K; ++a) C[a] += f1[a] * f2[a] * Csum[a];
+      N += matches.size();
+    }
+    /// \name Accessors
+    //@{
+    /// Number of triangles.
+    inline size_t count () const { return N; }
+    /** The three point function of each map, zero if there are no
+     *  triangles. */
+    void values (std::vector<TM>& C3) const
+    {
+      C3.resize (K);
+      for (size_t a=0; a < K; ++a) C3[a] = ((N > 0) ? C[a]/N : 0);
+    }
+    //@}
+  };
+
   /** Storage for pixel triangles.
    *  All possible triangles are stored, including cyclic permutations of
    *  triangle with the same side lengths.  See Pixel_Triangles_Isosceles or
    *  Pixel_Triangles_Equilateral for specialized versions.
    *
    *  The actual pixel values are stored, not the indices to the pixel list
-   *  as is done in the two point table.
+   *  as is done in the two point table.  The triangles are stored
+   *  contiguously, three pixels per triangle, so stepping through them
+   *  streams through memory.  The orientations are only calculated when
+   *  asked for, see calculate_orientations().
    */
   template<typename T>
   class Pixel_Triangles {
   private :
-    std::vector<std::vector<T> > triangles; // List of pixels in triangle.
+    std::vector<T> triangles; // Pixels in the triangles, 3 per triangle.
     std::vector<double> edge_length; // Length of triangle edges.
-     /// Orientation of the triangles.
-    std::vector<Orientation> orient;
-    // Vectors to the center of HEALPix pixels.
-    std::vector<vec3> v;
+    // Orientation of the triangles, true if righthanded.  This may be
+    // shorter than the list of triangles, see calculate_orientations().
+    std::vector<bool> orient;
+    // Vectors to the center of HEALPix pixels, shared by all instances.
+    const vec3 *v;
     // HEALPix Nside of the pixels in the triangles.
     size_t nside;
     // HEALPix ordering scheme for the pixels in the triangles.
@@ -101,13 +546,64 @@ namespace Npoint_Functions {
     /// Add a triangle to the list.
     inline void add (const T& p1, const T& p2, const T& p3)
     {
-      size_t n = triangles.size();
-      triangles.push_back (std::vector<T>(3));
-      triangles[n][0] = p1;
-      triangles[n][1] = p2;
-      triangles[n][2] = p3;
-      orient.push_back (calculate_orientation (v[p1], v[p2],
-                                               v[p3]));
+      triangles.push_back (p1);
+      triangles.push_back (p2);
+      triangles.push_back (p3);
+    }
+
+    /// Visitor storing the triangles in \a tri, see visit_triangles().
+    struct Appender {
+      std::vector<T>& tri;
+      const Twopt_Table<T>& table;
+      Appender (std::vector<T>& tri_, const Twopt_Table<T>& table_)
+        : tri(tri_), table(table_) {}
+      inline void operator() (T i1, T i2, const std::vector<T>& matches)
+      {
+        for (size_t k=0; k < matches.size(); ++k) {
+          tri.push_back (table.pixel_list(i1));
+          tri.push_back (table.pixel_list(i2));
+          tri.push_back (table.pixel_list(matches[k]));
+        }
+      }
+    };
+
+    /** Find the triangles and append them to the list.
+     *  The \a finder is called for all first vertices, the rows of \a
+     *  table.  When not already running in parallel the rows are split
+     *  into blocks found in parallel, each into its own buffer.  The
+     *  buffers are appended in block order so the triangles are in
+     *  exactly the same order as when found serially.
+     */
+    template<class Finder>
+    void find_in_blocks (const Finder& finder, const Twopt_Table<T>& table)
+    {
+      size_t Npix = table.Npix();
+#ifdef OMP
+      if ((! omp_in_parallel()) && (omp_get_max_threads() > 1)) {
+        // Many more blocks than threads to balance the load.
+        size_t Nblock = std::min (Npix, 16*static_cast<size_t>
+                                  (omp_get_max_threads()));
+        std::vector<std::vector<T> > buf (Nblock);
+#pragma omp parallel shared(buf, finder, table)
+        {
+#pragma omp for schedule(dynamic,1)
+          for (size_t b=0; b < Nblock; ++b) {
+            Appender app (buf[b], table);
+            finder (app, b*Npix/Nblock, (b+1)*Npix/Nblock);
+          }
+        }
+        size_t N = triangles.size();
+        for (size_t b=0; b < Nblock; ++b) N += buf[b].size();
+        triangles.reserve (N);
+        for (size_t b=0; b < Nblock; ++b) {
+          triangles.insert (triangles.end(), buf[b].begin(), buf[b].end());
+          std::vector<T>().swap (buf[b]);
+        }
+        return;
+      }
+#endif
+      Appender app (triangles, table);
+      finder (app, 0, Npix);
     }
 
     /// Set the edge lengths of the triangle
@@ -121,7 +617,7 @@ namespace Npoint_Functions {
 
     /** Internal routine for initializing the state of the class for a set
      *  of two point tables.  The list of vectors to the HEALPix pixel
-     *  centers is also calculated.
+     *  centers is taken from the shared pixel_vectors().
      */
     void initialize (const Twopt_Table<T>& t1,
                      const Twopt_Table<T>& t2,
@@ -131,12 +627,12 @@ namespace Npoint_Functions {
       set_edge_lengths (t1.bin_value(), t2.bin_value(), t3.bin_value());
       this->nside = t1.Nside();
       this->scheme = t1.Scheme();
-      fill_vector_list (t1.Nside(), t1.Scheme(), v);
+      v = pixel_vectors (t1.Nside(), t1.Scheme());
     }
 
   public :
     /// Generic constructor.
-    Pixel_Triangles () : triangles(), edge_length(3), orient(), v(),
+    Pixel_Triangles () : triangles(), edge_length(3), orient(), v(0),
                          nside(0), scheme(NEST) {}
 
     /** Reset the list of triangles.
@@ -145,10 +641,28 @@ namespace Npoint_Functions {
     inline void reset()
     { 
       triangles.clear();
-      v.clear();
+      v = 0;
       orient.clear();
     }
 
+    /** Calculate the orientations of all triangles.
+     *  The orientations are stored so later calls to orientation() are
+     *  simple lookups.  Without this orientation() calculates the
+     *  orientation each time it is called.  This is \b not thread safe so
+     *  it should be called before the triangles are shared between
+     *  threads.
+     */
+    void calculate_orientations ()
+    {
+      size_t N = size();
+      orient.resize (N);
+      for (size_t j=0; j < N; ++j) {
+        const T *p = &triangles[3*j];
+        orient[j] = (calculate_orientation (v[p[0]], v[p[1]], v[p[2]])
+                     == RIGHTHANDED);
+      }
+    }
+
     /** Find all triangles.
      *  Find all the triangles that can be made up from the provided two
      *  point tables.  It is assumed that all the two point tables are
@@ -160,27 +674,8 @@ namespace Npoint_Functions {
                          const Twopt_Table<T>& t2,
                          const Twopt_Table<T>& t3)
     {
-      T p1, p2;
-      T i2;
-      std::vector<T> trip;
-
       this->initialize (t1, t2, t3);
-
-      for (size_t i1=0; i1 < t1.Npix(); ++i1) {
-        p1 = t1.pixel_list(i1);
-        for (size_t j2=0; (j2 < t1.Nmax()) && (t1(i1,j2) != -1); ++j2) {
-          i2 = t1(i1,j2);
-          p2 = t1.pixel_list(i2);
-          // Finally can search for and add appropriate pairs.
-          trip.clear();
-          append_matches (&t2(i1,0), &t2(i1,t2.Nmax()),
-                          &t3(i2,0), &t3(i2,t3.Nmax()), trip);
-          // Now put all the triplets in the list.
-          for (size_t k=0; k < trip.size(); ++k) {
-            this->add (p1, p2, t1.pixel_list(trip[k]));
-          }
-        }
-      }
+      find_in_blocks (Scalene_Finder<T> (t1, t2, t3), t1);
     }
 
     /** \name Accessors
@@ -189,25 +684,33 @@ namespace Npoint_Functions {
     //@{
     /// Number of triangles in the list.
     inline size_t size() const
-    { return triangles.size(); }
+    { return triangles.size()/3; }
     /** The three pixels that are the corners of the requested triangle.
-     *  This value cannot (should not) be changed.
+     *  A pointer to the three consecutive pixels is returned.  This value
+     *  cannot (should not) be changed.
      */
-    inline const std::vector<T>& operator() (size_t j) const
-    { return triangles[j]; }
+    inline const T* operator() (size_t j) const
+    { return &triangles[3*j]; }
     /** The three pixels that are the corners of the requested triangle.
-     *  This value cannot (should not) be changed.
+     *  A pointer to the three consecutive pixels is returned.  This value
+     *  cannot (should not) be changed.
      */
-    inline const std::vector<T>& get (size_t j) const
-    { return triangles[j]; }
+    inline const T* get (size_t j) const
+    { return &triangles[3*j]; }
     /** Pixel index \a j of triangle \a i. */
     inline T get (size_t i, size_t j) const
-    { return triangles[i][j]; }
+    { return triangles[3*i+j]; }
     /** The Orientation of the triangle.
-     *   See calculate_orientation() for more details. 
+     *  See calculate_orientation() for more details.  If
+     *  calculate_orientations() has not been called the orientation is
+     *  calculated from scratch.
      */
     inline Orientation orientation (size_t j) const
-    { return orient[j]; }
+    {
+      if (j < orient.size()) return (orient[j] ? RIGHTHANDED : LEFTHANDED);
+      const T *p = &triangles[3*j];
+      return calculate_orientation (v[p[0]], v[p[1]], v[p[2]]);
+    }
     /** The edge lengths of the triangles.
      *  The edge lengths are the dot products between the vectors to the
      *  points of the triangle in the order
@@ -248,29 +751,8 @@ namespace Npoint_Functions {
     void find_triangles (const Twopt_Table<T>& tequal,
                          const Twopt_Table<T>& tother)
     {
-      T p1, p2;
-      T i2;
-      std::vector<T> trip;
-
       this->initialize (tother, tequal, tequal);
-
-      for (size_t i1=0; i1 < tother.Npix(); ++i1) {
-        p1 = tother.pixel_list(i1);
-        for (size_t j2=0; (j2 < tother.Nmax()) && (tother(i1,j2) != -1);
-             ++j2) {
-          i2 = tother(i1,j2);
-          p2 = tother.pixel_list(i2);
-          if (p2 < p1) continue; // Don't double count triangles.
-          // Finally can search for and add appropriate pairs.
-          trip.clear();
-          append_matches (&tequal(i1,0), &tequal(i1,tequal.Nmax()),
-                          &tequal(i2,0), &tequal(i2,tequal.Nmax()), trip);
-          // Now put all the triplets in the list.
-          for (size_t k=0; k < trip.size(); ++k) {
-            this->add (p1, p2, tequal.pixel_list(trip[k]));
-          }
-        }
-      }
+      this->find_in_blocks (Isosceles_Finder<T> (tequal, tother), tother);
     }
   };
 
@@ -294,30 +776,70 @@ namespace Npoint_Functions {
      */
     void find_triangles (const Twopt_Table<T>& t)
     {
-      T p1, p2;
-      T i2;
-      std::vector<T> trip;
-
       this->initialize(t, t, t);
+      this->find_in_blocks (Equilateral_Finder<T> (t), t);
+    }
+  };
 
-      for (size_t i1=0; i1 < t.Npix(); ++i1) {
-        p1 = t.pixel_list(i1);
-        for (size_t j2=0; (j2 < t.Nmax()) && (t(i1,j2) != -1); ++j2) {
-          i2 = t(i1,j2);
-          p2 = t.pixel_list(i2);
-          if (p2 < p1) continue;
-          // Finally can search for and add appropriate pairs.
-          trip.clear();
-          append_matches (i2, &t(i1,0), &t(i1,t.Nmax()),
-                          &t(i2,0), &t(i2,t.Nmax()), trip);
-          // Now put all the triplets in the list.
-          for (size_t k=0; k < trip.size(); ++k) {
-            this->add (p1, p2, t.pixel_list(trip[k]));
-          }
+  /** Calculate all auto and cross three point functions.
+   *  The \a K fields are stored in pixel major order in \a fields (see
+   *  make_pixel_major()) so each pixel lookup fetches all fields at once.
+   *  On return \a C3 is the \a K x \a K x \a K array (row major) of
+   *  \f$\langle m_a m_b m_c\rangle\f$ for all fields, found in a
+   *  single pass through the triangles.  The result is symmetrized over
+   *  the vertices of the triangles, which is appropriate for equilateral
+   *  triangles (Pixel_Triangles_Equilateral).
+   *
+   *  Consecutive triangles sharing their first two pixels (as they are
+   *  found by the triangle finders) are summed together so the outer
+   *  product over the fields is only done once per pixel pair.
+   *
+   *  \relates Pixel_Triangles
+   */
+  template<typename TM, typename T>
+  void calculate_threepoint_cross_function
+  (const std::vector<TM>& fields, size_t K,
+   const Pixel_Triangles<T>& triangles, std::vector<TM>& C3)
+  {
+    std::vector<TM> C (K*K*K, 0);
+    std::vector<TM> Csum (K);
+    const TM *f1, *f2, *f3;
+    size_t j = 0;
+    while (j < triangles.size()) {
+      T p1 = triangles.get(j,0);
+      T p2 = triangles.get(j,1);
+      std::fill (Csum.begin(), Csum.end(), 0);
+      while ((j < triangles.size()) && (triangles.get(j,0) == p1)
+             && (triangles.get(j,1) == p2)) {
+        f3 = &fields[triangles.get(j,2)*K];
+        for (size_t c=0; c < K; ++c) Csum[c] += f3[c];
+        ++j;
+      }
+      f1 = &fields[p1*K];
+      f2 = &fields[p2*K];
+      for (size_t a=0; a < K; ++a) {
+        for (size_t b=0; b < K; ++b) {
+          TM f12 = f1[a] * f2[b];
+          for (size_t c=0; c < K; ++c) C[(a*K+b)*K+c] += f12 * Csum[c];
         }
       }
     }
-  };
+
+    // Average over the permutations of the vertices.
+    C3.resize (K*K*K);
+    for (size_t a=0; a < K; ++a) {
+      for (size_t b=0; b < K; ++b) {
+        for (size_t c=0; c < K; ++c) {
+          C3[(a*K+b)*K+c] = (C[(a*K+b)*K+c] + C[(b*K+c)*K+a]
+                             + C[(c*K+a)*K+b] + C[(b*K+a)*K+c]
+                             + C[(a*K+c)*K+b] + C[(c*K+b)*K+a]) / 6;
+        }
+      }
+    }
+    if (triangles.size() > 0) {
+      for (size_t k=0; k < C3.size(); ++k) C3[k] /= triangles.size();
+    }
+  }
 }
 
 #endif
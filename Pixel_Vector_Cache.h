@@ -0,0 +1,167 @@
+#ifndef PIXEL_VECTOR_CACHE_H
+#define PIXEL_VECTOR_CACHE_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <healpix_base.h>
+#include <vec3.h>
+
+namespace {
+  /// @cond IDTAG
+  const std::string PIXEL_VECTOR_CACHE_RCSID
+  ("$Id$");
+  /// @endcond
+}
+
+namespace Npoint_Functions {
+  /** Process wide cache of the vectors to the HEALPix pixel centers.
+   *
+   *  Many routines need the vectors to all pixel centers for a given Nside
+   *  and scheme.  Rather than each of them (in each thread, for each bin)
+   *  calling pix2vec for every pixel, the vectors are calculated once and
+   *  shared read only.  The vectors are never freed, they live until the
+   *  program exits.
+   *
+   *  Optionally the vectors are persisted in a directory, set with
+   *  set_directory() or from the NPOINT_PIXEL_VECTOR_DIR environment
+   *  variable.  The first program to ask for a given Nside and scheme
+   *  writes a file there and later programs memory map it instead of
+   *  calculating the vectors again.  The files are raw vec3 values in
+   *  the native byte order so should not be moved between machines.
+   *
+   *  All access is done in a critical section so this is thread safe.
+   */
+  class Pixel_Vector_Cache {
+  private :
+    struct Block {
+      const vec3 *data;
+      std::vector<vec3> owned;
+      Block () : data(0), owned() {}
+    };
+    typedef std::map<std::pair<size_t, int>, Block> block_map;
+
+    static block_map& blocks ()
+    {
+      static block_map b;
+      return b;
+    }
+
+    static std::string& dir ()
+    {
+      static std::string d;
+      static bool initialized = false;
+      if (! initialized) {
+        const char *env = std::getenv ("NPOINT_PIXEL_VECTOR_DIR");
+        if (env != 0) d = env;
+        initialized = true;
+      }
+      return d;
+    }
+
+    /// Memory map \a Npix vectors from \a filename, 0 on failure.
+    static const vec3* map_file (const std::string& filename, size_t Npix)
+    {
+      int fd = ::open (filename.c_str(), O_RDONLY);
+      if (fd < 0) return 0;
+      struct stat st;
+      void *addr = MAP_FAILED;
+      if ((fstat (fd, &st) == 0)
+          && (static_cast<size_t>(st.st_size) == Npix*sizeof(vec3))) {
+        addr = mmap (0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      }
+      ::close (fd);
+      if (addr == MAP_FAILED) return 0;
+      return static_cast<const vec3*>(addr);
+    }
+
+    /** Write the vectors to \a filename.
+     *  A temporary file is renamed so other programs never see a
+     *  partially written file. */
+    static void write_file (const std::string& filename,
+                            const std::vector<vec3>& v)
+    {
+      std::ostringstream tmp;
+      tmp << filename << ".tmp" << getpid();
+      std::ofstream out (tmp.str().c_str(),
+                         std::fstream::out | std::fstream::trunc
+                         | std::fstream::binary);
+      out.write (reinterpret_cast<const char*>(&v[0]),
+                 v.size()*sizeof(vec3));
+      out.close();
+      if (out.fail() || (std::rename (tmp.str().c_str(), filename.c_str())
+                         != 0)) {
+        std::remove (tmp.str().c_str());
+      }
+    }
+  public :
+    /** Set the directory the vectors are persisted in.
+     *  An empty string turns persisting off.  This only affects vectors
+     *  not already in the cache.
+     */
+    static void set_directory (const std::string& directory)
+    {
+#pragma omp critical(pixel_vector_cache)
+      dir() = directory;
+    }
+
+    /** The vectors to the pixel centers.
+     *  The returned array has 12*Nside*Nside entries indexed by pixel
+     *  number in the \a scheme ordering.  It must not be freed.
+     */
+    static const vec3* get (size_t Nside, Healpix_Ordering_Scheme scheme)
+    {
+      const vec3 *v;
+#pragma omp critical(pixel_vector_cache)
+      {
+        Block& b = blocks()[std::make_pair (Nside, static_cast<int>(scheme))];
+        if (b.data == 0) {
+          size_t Npix = 12*Nside*Nside;
+          std::string filename;
+          if (dir() != "") {
+            std::ostringstream sstr;
+            sstr << dir() << "/pixel_vectors_" << Nside
+                 << ((scheme == NEST) ? "_nest" : "_ring") << ".dat";
+            filename = sstr.str();
+            b.data = map_file (filename, Npix);
+          }
+          if (b.data == 0) {
+            Healpix_Base HBase (Nside, scheme, SET_NSIDE);
+            b.owned.resize (Npix);
+            for (size_t i=0; i < Npix; ++i) b.owned[i] = HBase.pix2vec (i);
+            b.data = &b.owned[0];
+            if (filename != "") write_file (filename, b.owned);
+          }
+        }
+        v = b.data;
+      }
+      return v;
+    }
+  };
+
+  /** Vectors to the HEALPix pixel centers.
+   *  Short hand for Pixel_Vector_Cache::get().
+   */
+  inline const vec3* pixel_vectors (size_t Nside,
+                                    Healpix_Ordering_Scheme scheme)
+  { return Pixel_Vector_Cache::get (Nside, scheme); }
+}
+
+#endif
+
+/* For emacs, this is a c++ header
+ * Local Variables:
+ * mode: c++
+ * End:
+ */
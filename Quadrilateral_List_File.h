@@ -19,8 +19,20 @@ namespace {
 namespace Npoint_Functions {
   /** List of pixels for quadrilaterals stored in a compressed format.  *
    *  This is a "raw" class providing a wrapper around the file format used
-   *  to store lists of quadrilaterals.  It only provides read access to
-   *  the file.
+   *  to store lists of quadrilaterals.
+   *
+   *  At present version 1 of the file format is used.  This format is
+   *  version number (char)
+   *  Nside (size_t)
+   *  HEALPix scheme (char, 0==NEST, 1==RING)
+   *  bin value in degrees (double)
+   *  maximum record size in bytes (size_t)
+   *  records, each the size in bytes (size_t) followed by the values (T),
+   *  see next().
+   *
+   *  Reading and writing cannot be mixed.  Use initialize() and next() to
+   *  read a file and create(), add_quadrilateral(), and close() to write
+   *  one.
    */
   template<typename T>
   class Quadrilateral_List_File {
@@ -30,13 +42,23 @@ namespace Npoint_Functions {
     double binval;
     std::tr1::shared_ptr<std::ifstream> fd;
     T *buf;
+    std::streampos data_start; // Position of the first record.
+    std::vector<std::streampos> offsets; // Position of each record.
+    // For writing
+    std::tr1::shared_ptr<std::ofstream> fdout;
+    size_t maxbytes;
+    std::streampos maxbytes_pos; // Where to write maxbytes on close().
+    std::vector<T> rec; // Record being built by add_quadrilateral().
+    size_t n2pos, n3pos; // Position of the current Np2 and Np3 in rec.
   public :  
     /** Constructor.
      *  If a filename is provided the class is initialized and ready for
      *  use. */
     Quadrilateral_List_File (const std::string& filename="")
       : nside(0), scheme(NEST), binval(0.0),
-        fd(new std::ifstream), buf(0)
+        fd(new std::ifstream), buf(0), data_start(0), offsets(),
+        fdout(new std::ofstream), maxbytes(0), maxbytes_pos(0), rec(),
+        n2pos(0), n3pos(0)
     { if (filename != "") initialize (filename); }
 
     /** Destructor.
@@ -45,6 +67,7 @@ namespace Npoint_Functions {
     {
       if (fd->is_open()) fd->close();
       if (buf != 0) delete [] buf;
+      close();
     }
 
     /** Initialize. 
@@ -77,10 +100,48 @@ namespace Npoint_Functions {
 
       if (buf != 0) delete [] buf;
       buf = new T [ maxbytes/sizeof(T) ];
+      data_start = fd->tellg();
+      offsets.clear();
 
       return true;
     }
 
+    /** Build an index of the records in the file.
+     *  The file is scanned once and the position of every record (every
+     *  p0, see next()) is stored so records can be read in any order with
+     *  record().  After indexing next() starts again from the first
+     *  record.  The number of records is returned.
+     */
+    size_t build_index ()
+    {
+      size_t bytes;
+      offsets.clear();
+      fd->clear();
+      fd->seekg (data_start);
+      while (true) {
+        std::streampos pos = fd->tellg();
+        fd->read (reinterpret_cast<char*>(&bytes), sizeof(bytes));
+        if (! *fd) break;
+        offsets.push_back (pos);
+        fd->seekg (bytes, std::ios_base::cur);
+      }
+      fd->clear();
+      fd->seekg (data_start);
+      return offsets.size();
+    }
+
+    /** Get record \a n.
+     *  The format is the same as for next().  build_index() \b must be
+     *  called first.  This moves the position in the file so a following
+     *  call to next() returns record \a n+1.
+     */
+    T* record (size_t n)
+    {
+      fd->clear();
+      fd->seekg (offsets[n]);
+      return next();
+    }
+
     /** Get the next set of quadrilaterals to process.
 
      * A pointer to the memory is returned.  Do \b not free this memory or
@@ -103,6 +164,96 @@ namespace Npoint_Functions {
       return buf;
     }
 
+    /** Create a file for writing.
+     *  The header is written with the bin value \a bv in degrees.
+     */
+    bool create (const std::string& filename, size_t Nside,
+                 Healpix_Ordering_Scheme s, double bv)
+    {
+      close();
+      fdout->clear();
+      fdout->open (filename.c_str(), std::fstream::out | std::fstream::trunc
+                   | std::fstream::binary);
+      if (! *fdout) {
+        std::cerr << "Failed to open file " << filename << std::endl;
+        return false;
+      }
+      nside = Nside;
+      scheme = s;
+      binval = bv;
+      maxbytes = 0;
+      rec.clear();
+
+      char version = 1;
+      char sc = ((scheme == RING) ? 1 : 0);
+      fdout->write (&version, sizeof(version));
+      fdout->write (reinterpret_cast<char*>(&nside), sizeof(nside));
+      fdout->write (&sc, sizeof(sc));
+      fdout->write (reinterpret_cast<char*>(&binval), sizeof(binval));
+      maxbytes_pos = fdout->tellp();
+      fdout->write (reinterpret_cast<char*>(&maxbytes), sizeof(maxbytes));
+      return (! fdout->fail());
+    }
+
+    /// Write a record, in the format described in next().
+    void write_record (const std::vector<T>& r)
+    {
+      size_t bytes = r.size() * sizeof(T);
+      maxbytes = std::max (maxbytes, bytes);
+      fdout->write (reinterpret_cast<char*>(&bytes), sizeof(bytes));
+      fdout->write (reinterpret_cast<const char*>(&r[0]), bytes);
+    }
+
+    /** Add a quadrilateral to the file being written.
+     *  The quadrilaterals \b must be added in lexicographic order of the
+     *  pixels \a p[0], \a p[1], \a p[2], \a p[3] with no repeats.  They
+     *  are grouped into records as described in next() and each record is
+     *  written once all quadrilaterals starting with its \a p[0] have been
+     *  added.
+     */
+    void add_quadrilateral (const T p[4])
+    {
+      bool new_group = false;
+      if ((rec.size() > 0) && (p[0] != rec[0])) {
+        write_record (rec);
+        rec.clear();
+      }
+      if (rec.size() == 0) {
+        rec.push_back (p[0]);
+        rec.push_back (0);
+        new_group = true;
+      }
+      if (new_group || (p[1] != rec[n2pos-1])) {
+        rec.push_back (p[1]);
+        n2pos = rec.size();
+        rec.push_back (0);
+        ++rec[1];
+        new_group = true;
+      }
+      if (new_group || (p[2] != rec[n3pos-1])) {
+        rec.push_back (p[2]);
+        n3pos = rec.size();
+        rec.push_back (0);
+        ++rec[n2pos];
+      }
+      rec.push_back (p[3]);
+      ++rec[n3pos];
+    }
+
+    /** Finish writing the file.
+     *  The last record is written and the maximum record size is filled
+     *  into the header.  Nothing is done if no file is being written.
+     */
+    void close ()
+    {
+      if (! fdout->is_open()) return;
+      if (rec.size() > 0) write_record (rec);
+      rec.clear();
+      fdout->seekp (maxbytes_pos);
+      fdout->write (reinterpret_cast<char*>(&maxbytes), sizeof(maxbytes));
+      fdout->close();
+    }
+
     /// \name Accessors
     //@{
     /** Nside of the pixels in the quadrilateral list. */
@@ -112,9 +263,50 @@ namespace Npoint_Functions {
     /** Value at the center of the bin for this quadrilateral list.
      *  This is specific to rhombic quadrilaterals .... */
     double bin_value() const { return binval; }
+    /** Number of records found by build_index(). */
+    size_t Nrecord() const { return offsets.size(); }
     //@}
   };
 
+  /** Sum the four point products for one record.
+   *  The products of the map values for all the quadrilaterals in the
+   *  record \a arr (as returned by Quadrilateral_List_File::next()) are
+   *  summed and returned.  The number of quadrilaterals is added to \a
+   *  Nquad.
+   *
+   *  \relates Quadrilateral_List_File
+   */
+  template<typename TM, typename TL>
+  inline TM fourpoint_record_sum (const Healpix_Map<TM>& map, const TL* arr,
+                                  size_t& Nquad)
+  {
+    size_t ind = 0;
+    TL p[4];
+    TL N[4];
+    TM C[4];
+
+    p[0] = arr[ind++];
+    N[1] = arr[ind++];
+    C[1] = 0.0;
+    for (int n1=0; n1 < N[1]; ++n1) {
+      p[1] = arr[ind++];
+      N[2] = arr[ind++];
+      C[2] = 0.0;
+      for (int n2=0; n2 < N[2]; ++n2) {
+        p[2] = arr[ind++];
+        N[3] = arr[ind++];
+        Nquad += N[3];
+        C[3] = 0.0;
+        for (int n3=0; n3 < N[3]; ++n3) {
+          C[3] += map[arr[ind++]];
+        }
+        C[2] += map[p[2]] * C[3];
+      }
+      C[1] += map[p[1]] * C[2];
+    }
+    return map[p[0]] * C[1];
+  }
+
   // Not sure this really belongs here, but...
   /** Calculate the four point function.
    *  Use a Quadrilateral_List_File to calculate the four point function
@@ -127,40 +319,16 @@ namespace Npoint_Functions {
   TM calculate_fourpoint_function (const Healpix_Map<TM>& map,
                                    Quadrilateral_List_File<TL>& qlf)
   {
-    size_t ind;
-    TL p[4];
-    TL N[4];
     TL *arr;
     size_t Nquad = 0;
-    TM C[4];
-    C[0] = 0.0;
+    TM C = 0.0;
 
     while ((arr = qlf.next()) != 0) {
-      ind = 0;
-      p[0] = arr[ind++];
-      N[1] = arr[ind++];
-      C[1] = 0.0;
-      for (int n1=0; n1 < N[1]; ++n1) {
-        p[1] = arr[ind++];
-        N[2] = arr[ind++];
-        C[2] = 0.0;
-        for (int n2=0; n2 < N[2]; ++n2) {
-          p[2] = arr[ind++];
-          N[3] = arr[ind++];
-          Nquad += N[3];
-          C[3] = 0.0;
-          for (int n3=0; n3 < N[3]; ++n3) {
-            C[3] += map[arr[ind++]];
-          }
-          C[2] += map[p[2]] * C[3];
-        }
-        C[1] += map[p[1]] * C[2];
-      }
-      C[0] += map[p[0]] * C[1];
+      C += fourpoint_record_sum (map, arr, Nquad);
     }
 
-    if (Nquad > 0) C[0] /= Nquad;
-    return C[0];
+    if (Nquad > 0) C /= Nquad;
+    return C;
   }
 
   /** Calculate the four point function for a list of maps.
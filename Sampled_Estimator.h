@@ -0,0 +1,232 @@
+#ifndef SAMPLED_ESTIMATOR_H
+#define SAMPLED_ESTIMATOR_H
+
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include <time.h> // For clock_gettime
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+#include <healpix_map.h>
+#include <planck_rng.h>
+
+#include <Twopt_Table.h>
+#include <Pixel_Triangles.h>
+#include <Quadrilateral_List_File.h>
+
+namespace {
+  /// @cond IDTAG
+  const std::string SAMPLED_ESTIMATOR_RCSID
+  ("$Id$");
+  /// @endcond
+}
+
+namespace Npoint_Functions {
+  /** Ratio estimator for a sampled npoint function.
+   *
+   *  The products making up an npoint function are grouped into clusters,
+   *  for example a row of a two point table or all the quadrilaterals
+   *  starting at the same pixel.  For each sampled cluster the sum of the
+   *  products, \f$S_i\f$, and the number of products, \f$N_i\f$, are
+   *  added.  The npoint function is estimated by
+   *  \f$R = \sum S_i / \sum N_i\f$ with the standard error
+   *  \f[ \sigma_R^2 = \frac{1-f}{n(n-1)\bar N^2}
+   *      \sum_i (S_i - R N_i)^2 \f]
+   *  for \f$n\f$ clusters sampled without replacement from a total of
+   *  \f$N_{\rm pop}\f$, with \f$f=n/N_{\rm pop}\f$ the fraction sampled
+   *  and \f$\bar N\f$ the mean number of products per sampled cluster.
+   *  When all clusters are sampled the error is zero and the estimate
+   *  is the exact npoint function.
+   */
+  class Ratio_Estimator {
+  private :
+    double S, N, SS, SN, NN;
+    size_t n, Npop;
+  public :
+    /// Construct an estimator for \a Npop clusters.
+    Ratio_Estimator (size_t Npop_=0)
+      : S(0), N(0), SS(0), SN(0), NN(0), n(0), Npop(Npop_) {}
+
+    /// Reset the estimator for \a Npop_ clusters.
+    inline void reset (size_t Npop_)
+    { S = N = SS = SN = NN = 0; n = 0; Npop = Npop_; }
+
+    /// Add a cluster with sum of products \a value and \a count products.
+    inline void add (double value, double count)
+    {
+      S += value;
+      N += count;
+      SS += value*value;
+      SN += value*count;
+      NN += count*count;
+      ++n;
+    }
+
+    /// \name Accessors
+    //@{
+    /// The number of clusters sampled.
+    inline size_t size () const { return n; }
+    /// The fraction of the clusters sampled.
+    inline double fraction () const
+    { return ((Npop > 0) ? static_cast<double>(n)/Npop : 1); }
+    /// The estimate of the npoint function.
+    inline double value () const { return ((N > 0) ? S/N : 0); }
+    /// The standard error of value().
+    double error () const
+    {
+      if ((n < 2) || (N <= 0)) return 0;
+      double R = value();
+      double var = SS - 2*R*SN + R*R*NN;
+      if (var < 0) var = 0;
+      double Nbar = N/n;
+      return std::sqrt ((1 - fraction()) * var / (n*(n-1.0))) / Nbar;
+    }
+    //@}
+  };
+
+  /** Wall clock time in seconds, used for time budgets. */
+  inline double sampling_wall_time ()
+  {
+#ifdef OMP
+    return omp_get_wtime();
+#else
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+#endif
+  }
+
+  /** Sample an npoint function until it is accurate enough.
+   *  Clusters 0, ..., \a Npop-1 are drawn in a random order without
+   *  replacement using \a rng and passed to \a sampler as
+   *  sampler(i, value, count), which returns the sum of the products and
+   *  the number of products in cluster \a i.  These are accumulated in \a
+   *  est.  Sampling stops when all clusters have been used, when at least
+   *  \a min_samples clusters have been used and the relative standard
+   *  error is at most \a tolerance, or when \a max_time seconds have
+   *  passed (if \a max_time is positive).  Using the same seed for \a rng
+   *  gives the same result.
+   *
+   *  \relates Ratio_Estimator
+   */
+  template<class Sampler>
+  void sample_npoint_function (Sampler& sampler, size_t Npop,
+                               planck_rng& rng, double tolerance,
+                               double max_time, Ratio_Estimator& est,
+                               size_t min_samples=100)
+  {
+    est.reset (Npop);
+    std::vector<size_t> order (Npop);
+    for (size_t i=0; i < Npop; ++i) order[i] = i;
+    double tstart = sampling_wall_time();
+    double value, count;
+    for (size_t n=0; n < Npop; ++n) {
+      // Partial Fisher-Yates shuffle, one element at a time.
+      size_t j = n + static_cast<size_t>(rng.rand_uni() * (Npop-n));
+      if (j >= Npop) j = Npop-1;
+      std::swap (order[n], order[j]);
+      sampler (order[n], value, count);
+      est.add (value, count);
+
+      if (est.size() < min_samples) continue;
+      // A zero estimate usually means nothing has been found yet.
+      if ((est.value() != 0)
+          && (est.error() <= tolerance * std::fabs(est.value())))
+        break;
+      if ((max_time > 0) && (sampling_wall_time() - tstart > max_time))
+        break;
+    }
+  }
+
+  /** Sample rows of a two point table.
+   *  Each cluster is a row of the table, all pairs with the pixel as one
+   *  end.  Every pair appears in two rows which does not change the
+   *  ratio estimate.
+   *  \relates Ratio_Estimator
+   */
+  template<typename TM, typename T>
+  class Twopt_Row_Sampler {
+  private :
+    const Healpix_Map<TM>& map;
+    const Twopt_Table<T>& table;
+  public :
+    Twopt_Row_Sampler (const Healpix_Map<TM>& map_,
+                       const Twopt_Table<T>& table_)
+      : map(map_), table(table_) {}
+    /// The number of clusters.
+    inline size_t size () const { return table.Npix(); }
+    void operator() (size_t i, double& value, double& count)
+    {
+      TM Csum = 0;
+      size_t j;
+      for (j=0; (j < table.Nmax()) && (table(i,j) != -1); ++j) {
+        Csum += map[table.pixel_list(table(i,j))];
+      }
+      value = map[table.pixel_list(i)] * Csum;
+      count = j;
+    }
+  };
+
+  /** Sample equilateral triangles by their first vertex.
+   *  Each cluster is all the triangles with a given pixel as their
+   *  smallest vertex, found with visit_equilateral_triangles() for that
+   *  row alone.  Only the triangles in sampled rows are ever found.
+   *  \relates Ratio_Estimator
+   */
+  template<typename TM, typename T>
+  class Equilateral_Triangle_Sampler {
+  private :
+    const Twopt_Table<T>& table;
+    Threepoint_Kernel<TM, T> kernel;
+  public :
+    Equilateral_Triangle_Sampler (const Healpix_Map<TM>& map_,
+                                  const Twopt_Table<T>& table_)
+      : table(table_), kernel(map_, table_) {}
+    /// The number of clusters.
+    inline size_t size () const { return table.Npix(); }
+    void operator() (size_t i, double& value, double& count)
+    {
+      kernel.reset();
+      visit_equilateral_triangles (table, kernel, i, i+1);
+      value = kernel.sum();
+      count = kernel.count();
+    }
+  };
+
+  /** Sample records of a quadrilateral list.
+   *  Each cluster is one record of the list, all the quadrilaterals
+   *  starting at the same pixel p0.  The list \b must be indexed with
+   *  Quadrilateral_List_File::build_index() first.
+   *  \relates Ratio_Estimator
+   */
+  template<typename TM, typename TL>
+  class Quadrilateral_Record_Sampler {
+  private :
+    const Healpix_Map<TM>& map;
+    Quadrilateral_List_File<TL>& qlf;
+  public :
+    Quadrilateral_Record_Sampler (const Healpix_Map<TM>& map_,
+                                  Quadrilateral_List_File<TL>& qlf_)
+      : map(map_), qlf(qlf_) {}
+    /// The number of clusters.
+    inline size_t size () const { return qlf.Nrecord(); }
+    void operator() (size_t i, double& value, double& count)
+    {
+      size_t Nquad = 0;
+      value = fourpoint_record_sum (map, qlf.record(i), Nquad);
+      count = Nquad;
+    }
+  };
+}
+
+#endif
+
+/* For emacs, this is a c++ header
+ * Local Variables:
+ * mode: c++
+ * End:
+ */
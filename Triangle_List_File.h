@@ -0,0 +1,371 @@
+#ifndef TRIANGLE_LIST_FILE_H
+#define TRIANGLE_LIST_FILE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <tr1/memory> // For std::tr1::shared_ptr
+
+#include <healpix_map.h>
+
+#include <Twopt_Table.h>
+
+namespace {
+  /// @cond IDTAG
+  const std::string TRIANGLE_LIST_FILE_RCSID
+  ("$Id$");
+  /// @endcond
+}
+
+namespace Npoint_Functions {
+  /** List of pixels for triangles stored in a compressed format.
+   *
+   *  This is the three point analog of Quadrilateral_List_File.  Finding
+   *  triangles from two point tables only depends on the tables, so the
+   *  triangles can be found once, written to a file, and the file
+   *  streamed for every map.  The triangles are stored in records, one
+   *  for each first vertex, in the "recursive" order
+   *  p1 Np2 { p2 Np3 (p3 p3 ...) p2 Np3 (p3 ...) ... }
+   *  of pixel numbers.
+   *
+   *  At present version 1 of the file format is used.  This format is
+   *  version number (char)
+   *  Nside (size_t)
+   *  HEALPix scheme (char, 0==NEST, 1==RING)
+   *  bin values of the three sides (3 doubles, p1-p2, p1-p3, p2-p3)
+   *  maximum record size in bytes (size_t)
+   *  records, each the size in bytes (size_t) followed by the values (T).
+   *
+   *  Like Twopt_Table, reading and writing cannot be mixed.  Use
+   *  initialize() and next() to read a file and create(), write_record(),
+   *  and close() to write one.  Triangle_List_Writer writes the triangles
+   *  as they are found by the triangle visitors.
+   */
+  template<typename T>
+  class Triangle_List_File {
+  private :
+    size_t nside;
+    Healpix_Ordering_Scheme scheme;
+    double binval[3];
+    std::tr1::shared_ptr<std::ifstream> fd;
+    std::tr1::shared_ptr<std::ofstream> fdout;
+    std::vector<T> buf;
+    size_t maxbytes;
+    std::streampos maxbytes_pos; // Where to write maxbytes on close().
+    std::streampos data_start; // Position of the first record.
+    std::vector<std::streampos> offsets; // Position of each record.
+  public :
+    /** Constructor.
+     *  If a filename is provided the class is initialized for reading and
+     *  ready for use. */
+    Triangle_List_File (const std::string& filename="")
+      : nside(0), scheme(NEST), fd(new std::ifstream),
+        fdout(new std::ofstream), buf(), maxbytes(0), maxbytes_pos(0),
+        data_start(0), offsets()
+    {
+      binval[0] = binval[1] = binval[2] = 0;
+      if (filename != "") initialize (filename);
+    }
+
+    /** Destructor.
+     *  Close the files. */
+    ~Triangle_List_File ()
+    {
+      if (fd->is_open()) fd->close();
+      close();
+    }
+
+    /** Initialize for reading.
+     *  The file is opened, the header read, and prepared for use.  See
+     *  next() for usage.  On error the file is left in an indeterminant
+     *  state.
+     */
+    bool initialize (const std::string& filename)
+    {
+      if (fd->is_open()) fd->close();
+      fd->clear();
+      fd->open (filename.c_str(), std::fstream::in | std::fstream::binary);
+      if (! *fd) {
+        std::cerr << "Failed to open file " << filename << std::endl;
+        return false;
+      }
+
+      // Read header.
+      char version, s;
+      fd->read (&version, sizeof(version));
+      if (version != 1) {
+        std::cerr << "Only version 1 supported\n";
+        return false;
+      }
+      fd->read (reinterpret_cast<char*>(&nside), sizeof(nside));
+      fd->read (&s, sizeof(s));
+      if (s == 0) scheme = NEST;
+      else scheme = RING;
+      fd->read (reinterpret_cast<char*>(binval), sizeof(binval));
+      fd->read (reinterpret_cast<char*>(&maxbytes), sizeof(maxbytes));
+      if (! *fd) return false;
+
+      buf.resize (std::max (maxbytes/sizeof(T), static_cast<size_t>(1)));
+      data_start = fd->tellg();
+      offsets.clear();
+
+      return true;
+    }
+
+    /** Build an index of the records in the file.
+     *  Same as Quadrilateral_List_File::build_index().  The number of
+     *  records is returned.
+     */
+    size_t build_index ()
+    {
+      size_t bytes;
+      offsets.clear();
+      fd->clear();
+      fd->seekg (data_start);
+      while (true) {
+        std::streampos pos = fd->tellg();
+        fd->read (reinterpret_cast<char*>(&bytes), sizeof(bytes));
+        if (! *fd) break;
+        offsets.push_back (pos);
+        fd->seekg (bytes, std::ios_base::cur);
+      }
+      fd->clear();
+      fd->seekg (data_start);
+      return offsets.size();
+    }
+
+    /** Get record \a n.
+     *  build_index() \b must be called first.
+     */
+    const T* record (size_t n)
+    {
+      fd->clear();
+      fd->seekg (offsets[n]);
+      return next();
+    }
+
+    /** Get the next record of triangles to process.
+     *  A pointer to the record, in the format described for the class,
+     *  is returned.  It is valid until the next call to next() or
+     *  record().  When no more triangles are available "0" is returned.
+     */
+    const T* next ()
+    {
+      size_t bytes;
+
+      fd->read (reinterpret_cast<char*>(&bytes), sizeof(bytes));
+      if (! *fd) return 0;
+
+      fd->read (reinterpret_cast<char*>(&buf[0]), bytes);
+      return &buf[0];
+    }
+
+    /** Create a file for writing.
+     *  The header is written with the bin values \a bv of the three sides.
+     */
+    bool create (const std::string& filename, size_t Nside,
+                 Healpix_Ordering_Scheme s, const double bv[3])
+    {
+      close();
+      fdout->clear();
+      fdout->open (filename.c_str(), std::fstream::out | std::fstream::trunc
+                   | std::fstream::binary);
+      if (! *fdout) {
+        std::cerr << "Failed to open file " << filename << std::endl;
+        return false;
+      }
+      nside = Nside;
+      scheme = s;
+      std::copy (bv, bv+3, binval);
+      maxbytes = 0;
+
+      char version = 1;
+      char sc = ((scheme == RING) ? 1 : 0);
+      fdout->write (&version, sizeof(version));
+      fdout->write (reinterpret_cast<char*>(&nside), sizeof(nside));
+      fdout->write (&sc, sizeof(sc));
+      fdout->write (reinterpret_cast<char*>(binval), sizeof(binval));
+      maxbytes_pos = fdout->tellp();
+      fdout->write (reinterpret_cast<char*>(&maxbytes), sizeof(maxbytes));
+      return (! fdout->fail());
+    }
+
+    /// Write a record, in the format described for the class.
+    void write_record (const std::vector<T>& rec)
+    {
+      size_t bytes = rec.size() * sizeof(T);
+      maxbytes = std::max (maxbytes, bytes);
+      fdout->write (reinterpret_cast<char*>(&bytes), sizeof(bytes));
+      fdout->write (reinterpret_cast<const char*>(&rec[0]), bytes);
+    }
+
+    /** Finish writing the file.
+     *  The maximum record size is filled into the header.  Nothing is
+     *  done if no file is being written.
+     */
+    void close ()
+    {
+      if (! fdout->is_open()) return;
+      fdout->seekp (maxbytes_pos);
+      fdout->write (reinterpret_cast<char*>(&maxbytes), sizeof(maxbytes));
+      fdout->close();
+    }
+
+    /// \name Accessors
+    //@{
+    /** Nside of the pixels in the triangle list. */
+    size_t Nside () const { return nside; }
+    /** Scheme of the pixels in the triangle list. */
+    Healpix_Ordering_Scheme Scheme () const { return scheme; }
+    /** Bin value of side \a k, 0 for p1-p2, 1 for p1-p3, 2 for p2-p3. */
+    double bin_value (size_t k) const { return binval[k]; }
+    /** Number of records found by build_index(). */
+    size_t Nrecord () const { return offsets.size(); }
+    //@}
+  };
+
+  /** Write triangles to a Triangle_List_File as they are found.
+   *  This is a visitor for visit_triangles() and friends.  The visitors
+   *  find all triangles with the same first vertex together so each
+   *  first vertex becomes a record.  The indices are converted to pixel
+   *  numbers with \a table.  Call finish() after visiting to write the
+   *  last record.
+   *  \relates Triangle_List_File
+   */
+  template<typename T>
+  class Triangle_List_Writer {
+  private :
+    Triangle_List_File<T>& tlf;
+    const Twopt_Table<T>& table;
+    std::vector<T> rec;
+    T i1curr;
+    size_t N;
+  public :
+    Triangle_List_Writer (Triangle_List_File<T>& tlf_,
+                          const Twopt_Table<T>& table_)
+      : tlf(tlf_), table(table_), rec(), i1curr(-1), N(0) {}
+    void operator() (T i1, T i2, const std::vector<T>& matches)
+    {
+      if (i1 != i1curr) {
+        finish();
+        i1curr = i1;
+        rec.push_back (table.pixel_list(i1));
+        rec.push_back (0);
+      }
+      ++rec[1];
+      rec.push_back (table.pixel_list(i2));
+      rec.push_back (matches.size());
+      for (size_t k=0; k < matches.size(); ++k)
+        rec.push_back (table.pixel_list(matches[k]));
+      N += matches.size();
+    }
+    /// Write the current record, if any.
+    void finish ()
+    {
+      if (rec.size() > 0) tlf.write_record (rec);
+      rec.clear();
+      i1curr = -1;
+    }
+    /// Number of triangles written.
+    inline size_t count () const { return N; }
+  };
+
+  /** Sum the three point products for one record.
+   *  The products of the map values for all the triangles in the record
+   *  \a arr (as returned by Triangle_List_File::next()) are summed and
+   *  returned.  The number of triangles is added to \a Ntri.
+   *
+   *  \relates Triangle_List_File
+   */
+  template<typename TM, typename TL>
+  inline TM threepoint_record_sum (const Healpix_Map<TM>& map, const TL* arr,
+                                   size_t& Ntri)
+  {
+    size_t ind = 0;
+    TL p1 = arr[ind++];
+    TL N2 = arr[ind++];
+    TM C2 = 0, C3;
+    for (TL n2=0; n2 < N2; ++n2) {
+      TL p2 = arr[ind++];
+      TL N3 = arr[ind++];
+      Ntri += N3;
+      C3 = 0;
+      for (TL n3=0; n3 < N3; ++n3) {
+        C3 += map[arr[ind++]];
+      }
+      C2 += map[p2] * C3;
+    }
+    return map[p1] * C2;
+  }
+
+  /** Calculate the three point function.
+   *  Use a Triangle_List_File to calculate the three point function for
+   *  the provided HEALPix map.  It is \b assumed that the scheme of the
+   *  map is the same as that of the triangle list.
+   *
+   *  \relates Triangle_List_File
+   */
+  template<typename TM, typename TL>
+  TM calculate_threepoint_function (const Healpix_Map<TM>& map,
+                                    Triangle_List_File<TL>& tlf)
+  {
+    TM C = 0;
+    size_t Ntri = 0;
+    const TL *arr;
+    while ((arr = tlf.next()) != 0) {
+      C += threepoint_record_sum (map, arr, Ntri);
+    }
+    if (Ntri > 0) C /= Ntri;
+    return C;
+  }
+
+  /** Calculate the three point function for a list of maps.
+   *  Same as calculate_threepoint_function() for the maps stored in
+   *  pixel major order, as created by make_pixel_major(), so the list is
+   *  read once for all \a K maps.
+   *
+   *  \relates Triangle_List_File
+   */
+  template<typename TM, typename TL>
+  void calculate_threepoint_function_list (const std::vector<TM>& fields,
+                                           size_t K,
+                                           Triangle_List_File<TL>& tlf,
+                                           std::vector<TM>& C3)
+  {
+    C3.assign (K, 0);
+    std::vector<TM> C2(K), Csum(K);
+    size_t Ntri = 0, ind;
+    const TL *arr;
+    while ((arr = tlf.next()) != 0) {
+      ind = 0;
+      const TM *f1 = &fields[arr[ind++]*K];
+      TL N2 = arr[ind++];
+      std::fill (C2.begin(), C2.end(), 0);
+      for (TL n2=0; n2 < N2; ++n2) {
+        const TM *f2 = &fields[arr[ind++]*K];
+        TL N3 = arr[ind++];
+        Ntri += N3;
+        std::fill (Csum.begin(), Csum.end(), 0);
+        for (TL n3=0; n3 < N3; ++n3) {
+          const TM *f3 = &fields[arr[ind++]*K];
+          for (size_t a=0; a < K; ++a) Csum[a] += f3[a];
+        }
+        for (size_t a=0; a < K; ++a) C2[a] += f2[a] * Csum[a];
+      }
+      for (size_t a=0; a < K; ++a) C3[a] += f1[a] * C2[a];
+    }
+    if (Ntri > 0) {
+      for (size_t a=0; a < K; ++a) C3[a] /= Ntri;
+    }
+  }
+}
+
+#endif
+
+/* For emacs, this is a c++ header
+ * Local Variables:
+ * mode: c++
+ * End:
+ */
@@ -0,0 +1,129 @@
+#ifndef TWOPT_DIRECT_H
+#define TWOPT_DIRECT_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+#include <healpix_map.h>
+#include <vec3.h>
+
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  /// @cond IDTAG
+  const std::string TWOPT_DIRECT_RCSID
+  ("$Id$");
+  /// @endcond
+}
+
+namespace Npoint_Functions {
+  /** Calculate the two point function by direct pair summation.
+   *
+   *  No two point tables are used.  Instead the separation of every pair
+   *  of pixels in \a pixel_list is calculated on the fly from the vectors
+   *  to the pixel centers, binned using the bin edges \a cosbin (see
+   *  create_bins()), and the product of the map values accumulated into
+   *  the bin.  All bins are filled in a single pass over the pairs.  The
+   *  sum of the map products is returned in \a C2 (not normalized) and
+   *  the number of pairs in each bin in \a Npair, so the two point
+   *  function is C2[k]/Npair[k].
+   *
+   *  The pairs are split into square tiles of \a tile_size pixels on a
+   *  side.  The tiles are distributed among the threads and each thread
+   *  accumulates into its own bins which are combined at the end.  Within
+   *  a tile the pixels are near each other (for a sorted NEST pixel list)
+   *  so the same short linear bin search used by create_twopt_table is
+   *  efficient.
+   *
+   *  This is meant for low resolution maps (Nside of 128 or less) where
+   *  generating, storing, and reading the two point tables costs more
+   *  than recalculating the separations.  The cost scales as the square of
+   *  the number of pixels.  It is \b assumed that the pixel numbers in \a
+   *  pixel_list are in the scheme of \a map.
+   */
+  template<typename TM>
+  void calculate_twopt_function_direct (const Healpix_Map<TM>& map,
+                                        const std::vector<int>& pixel_list,
+                                        const std::vector<double>& cosbin,
+                                        std::vector<TM>& C2,
+                                        std::vector<size_t>& Npair,
+                                        size_t tile_size=1024)
+  {
+    size_t Nbin = cosbin.size() - 1;
+    size_t Npix = pixel_list.size();
+    C2.assign (Nbin, 0);
+    Npair.assign (Nbin, 0);
+    if ((Npix < 2) || (Nbin == 0)) return;
+    if (tile_size == 0) tile_size = 1;
+
+    // Vectors and map values in pixel list order.
+    std::vector<vec3> veclist (Npix);
+    std::vector<TM> mapval (Npix);
+    {
+      const vec3 *allvec = pixel_vectors (map.Nside(), map.Scheme());
+      for (size_t i=0; i < Npix; ++i) {
+        veclist[i] = allvec[pixel_list[i]];
+        mapval[i] = map[pixel_list[i]];
+      }
+    }
+
+    // Tiles (I,J) with I <= J are labelled sequentially.
+    size_t Ntile = (Npix + tile_size - 1) / tile_size;
+    std::vector<size_t> tileI, tileJ;
+    for (size_t I=0; I < Ntile; ++I) {
+      for (size_t J=I; J < Ntile; ++J) {
+        tileI.push_back (I);
+        tileJ.push_back (J);
+      }
+    }
+
+#pragma omp parallel shared(veclist, mapval, tileI, tileJ, C2, Npair)
+    {
+      std::vector<TM> Csum (Nbin, 0);
+      std::vector<size_t> Nsum (Nbin, 0);
+      size_t ibin = 0;
+      double dp;
+      int dir;
+
+#pragma omp for schedule(dynamic,1)
+      for (size_t t=0; t < tileI.size(); ++t) {
+        size_t iend = std::min ((tileI[t]+1)*tile_size, Npix);
+        size_t jend = std::min ((tileJ[t]+1)*tile_size, Npix);
+        for (size_t i=tileI[t]*tile_size; i < iend; ++i) {
+          size_t jstart = (tileI[t] == tileJ[t]) ? i+1 : tileJ[t]*tile_size;
+          for (size_t j=jstart; j < jend; ++j) {
+            dp = dotprod (veclist[i], veclist[j]);
+            if (dp > cosbin[ibin]) dir = +1;
+            else dir = -1;
+            // See create_twopt_table for a discussion of this search.
+            while ((dp < cosbin[ibin]) || (dp > cosbin[ibin+1]))
+              ibin += dir;
+            Csum[ibin] += mapval[i] * mapval[j];
+            ++Nsum[ibin];
+          }
+        }
+      }
+
+#pragma omp critical
+      {
+        for (size_t k=0; k < Nbin; ++k) {
+          C2[k] += Csum[k];
+          Npair[k] += Nsum[k];
+        }
+      }
+    }
+  }
+}
+
+#endif
+
+/* For emacs, this is a c++ header
+ * Local Variables:
+ * mode: c++
+ * End:
+ */
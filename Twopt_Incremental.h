@@ -0,0 +1,213 @@
+#ifndef TWOPT_INCREMENTAL_H
+#define TWOPT_INCREMENTAL_H
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+#include <healpix_map.h>
+
+#include <Twopt_Table.h>
+
+namespace {
+  /// @cond IDTAG
+  const std::string TWOPT_INCREMENTAL_RCSID
+  ("$Id$");
+  /// @endcond
+}
+
+namespace Npoint_Functions {
+  /** Incrementally updated two point function.
+   *
+   *  This is meant for iterative calculations, such as inpainting or
+   *  constrained realizations, where only a small number of pixels in the
+   *  map change between evaluations of the two point function.  All the
+   *  two point tables are read once and kept in memory along with the sum
+   *  of map products in each bin.  When pixels change only the rows of
+   *  the tables for those pixels are visited so the cost of an update is
+   *  proportional to the number of changed pixels, not the number of
+   *  pairs.
+   *
+   *  The update is exact (up to roundoff).  For a set of changed pixels
+   *  \f$D\f$ with \f$\Delta_i = m_i^{\rm new} - m_i^{\rm old}\f$ the change
+   *  in the sum for a bin is
+   *  \f[ \sum_{i\in D} \Delta_i \sum_{j\in{\rm row}(i)} \hat m_j \f]
+   *  where \f$\hat m_j\f$ is the old map value for unchanged pixels and
+   *  the average of the old and new values for changed pixels.  This
+   *  correctly accounts for pairs where both pixels change.  Since
+   *  roundoff accumulates over many updates recalculate() may be called
+   *  occasionally to start the sums fresh.
+   *
+   *  All tables are held in memory so this is only practical when the
+   *  full table set fits in memory.
+   */
+  template<typename T>
+  class Twopt_Incremental {
+  private :
+    std::vector<Twopt_Table<T> > tables;
+    std::vector<double> Csum; // Sum of map products in each bin.
+    std::vector<size_t> Npair; // Number of pairs in each bin.
+    std::vector<double> mapval; // Map values by table index.
+    std::vector<T> index; // Table index by pixel number, -1 if none.
+
+    // True if tables a and b have the same pixel list.
+    static bool same_pixels (const Twopt_Table<T>& a,
+                             const Twopt_Table<T>& b)
+    {
+      return ((a.Nside() == b.Nside()) && (a.Scheme() == b.Scheme())
+              && (a.pixel_list() == b.pixel_list()));
+    }
+  public :
+    /// Generic constructor.
+    Twopt_Incremental () : tables(), Csum(), Npair(), mapval(), index() {}
+
+    /** Initialize with a map and a set of two point tables.
+     *  All the tables in \a twopt_files are read and the sums for all bins
+     *  calculated from scratch.  The tables \b must share the same pixel
+     *  list.  The map is converted to the scheme of the tables, if
+     *  necessary.  On error false is returned.
+     */
+    bool initialize (const Healpix_Map<double>& map,
+                     const std::vector<std::string>& twopt_files)
+    {
+      tables.resize (twopt_files.size());
+      for (size_t k=0; k < twopt_files.size(); ++k) {
+        if (! tables[k].read_file (twopt_files[k])) {
+          std::cerr << "Error reading two point table "
+                    << twopt_files[k] << std::endl;
+          return false;
+        }
+        if ((k > 0) && (! same_pixels (tables[k], tables[0]))) {
+          std::cerr << "Two point tables do not share the same"
+                    << " pixel list\n";
+          return false;
+        }
+      }
+      if (tables.size() == 0) return true;
+      if (static_cast<size_t>(map.Nside()) != tables[0].Nside()) {
+        std::cerr << "Map and two point tables do not have the same Nside: "
+                  << map.Nside() << " != " << tables[0].Nside()
+                  << std::endl;
+        return false;
+      }
+
+      const Twopt_Table<T>& t = tables[0];
+      index.assign (map.Npix(), -1);
+      for (size_t i=0; i < t.Npix(); ++i) index[t.pixel_list(i)] = i;
+      mapval.resize (t.Npix());
+      if (map.Scheme() == t.Scheme()) {
+        for (size_t i=0; i < t.Npix(); ++i)
+          mapval[i] = map[t.pixel_list(i)];
+      } else {
+        Healpix_Map<double> m (map);
+        m.swap_scheme();
+        for (size_t i=0; i < t.Npix(); ++i)
+          mapval[i] = m[t.pixel_list(i)];
+      }
+
+      recalculate();
+      return true;
+    }
+
+    /** Recalculate the sums in all bins from scratch.
+     *  This traverses all the tables.  It is only needed to remove the
+     *  accumulated roundoff error after many calls to update().
+     */
+    void recalculate ()
+    {
+      Csum.assign (tables.size(), 0);
+      Npair.assign (tables.size(), 0);
+#pragma omp parallel for schedule(guided)
+      for (size_t k=0; k < tables.size(); ++k) {
+        const Twopt_Table<T>& t = tables[k];
+        double C = 0, Crow;
+        size_t N = 0;
+        for (size_t i=0; i < t.Npix(); ++i) {
+          Crow = 0;
+          for (size_t j=0; (j < t.Nmax()) && (t(i,j) != -1); ++j) {
+            if (static_cast<size_t>(t(i,j)) < i) continue; // Count once.
+            Crow += mapval[t(i,j)];
+            ++N;
+          }
+          C += mapval[i] * Crow;
+        }
+        Csum[k] = C;
+        Npair[k] = N;
+      }
+    }
+
+    /** Update the map and the two point function.
+     *  The map values at the pixel numbers in \a pixels are changed to \a
+     *  values.  The old values are those currently held by this object.
+     *  The sums for every bin are updated by visiting only the rows of the
+     *  tables for the changed pixels.  Each pixel \b must appear only once
+     *  in \a pixels.  Pixels not in the two point tables, including pixel
+     *  numbers outside the map, are ignored.
+     */
+    void update (const std::vector<T>& pixels,
+                 const std::vector<double>& values)
+    {
+      // Changed table indices and their changes.
+      std::vector<T> ind;
+      std::vector<double> delta, newval;
+      for (size_t n=0; n < pixels.size(); ++n) {
+        if ((pixels[n] < 0)
+            || (static_cast<size_t>(pixels[n]) >= index.size())) continue;
+        T i = index[pixels[n]];
+        if (i < 0) continue;
+        ind.push_back (i);
+        delta.push_back (values[n] - mapval[i]);
+        newval.push_back (values[n]);
+      }
+      if (ind.size() == 0) return;
+
+      // Average the old and new values of the changed pixels in place.
+      for (size_t n=0; n < ind.size(); ++n) mapval[ind[n]] += 0.5*delta[n];
+
+#pragma omp parallel for schedule(guided)
+      for (size_t k=0; k < tables.size(); ++k) {
+        const Twopt_Table<T>& t = tables[k];
+        double dC = 0, Crow;
+        for (size_t n=0; n < ind.size(); ++n) {
+          Crow = 0;
+          for (size_t j=0; (j < t.Nmax()) && (t(ind[n],j) != -1); ++j) {
+            Crow += mapval[t(ind[n],j)];
+          }
+          dC += delta[n] * Crow;
+        }
+        Csum[k] += dC;
+      }
+
+      for (size_t n=0; n < ind.size(); ++n) mapval[ind[n]] = newval[n];
+    }
+
+    /// \name Accessors
+    //@{
+    /// The number of bins.
+    inline size_t Nbin () const { return tables.size(); }
+    /// The value of the center of bin \a k.
+    inline double bin_value (size_t k) const
+    { return tables[k].bin_value(); }
+    /// The two point function in bin \a k.
+    inline double correlation (size_t k) const
+    { return ((Npair[k] > 0) ? Csum[k]/Npair[k] : 0); }
+    /// The two point function in all bins.
+    void correlation (std::vector<double>& C) const
+    {
+      C.resize (Nbin());
+      for (size_t k=0; k < Nbin(); ++k) C[k] = correlation(k);
+    }
+    /** The current map value at pixel number \a p.
+     *  The pixel \b must be in the two point tables. */
+    inline double map_value (T p) const { return mapval[index[p]]; }
+    //@}
+  };
+}
+
+#endif
+
+/* For emacs, this is a c++ header
+ * Local Variables:
+ * mode: c++
+ * End:
+ */
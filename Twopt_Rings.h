@@ -0,0 +1,240 @@
+#ifndef TWOPT_RINGS_H
+#define TWOPT_RINGS_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <tr1/memory> // For std::tr1::shared_ptr
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+#include <healpix_map.h>
+#include <arr.h>
+#include <xcomplex.h>
+#include <fftpack_support.h>
+
+namespace {
+  /// @cond IDTAG
+  const std::string TWOPT_RINGS_RCSID
+  ("$Id$");
+  /// @endcond
+}
+
+namespace Npoint_Functions {
+  /** Calculate the two point function of a full sky map from its rings.
+   *
+   *  No two point tables are used.  The pixels of a HEALPix map lie on
+   *  iso-latitude rings with equally spaced pixels.  For two rings with
+   *  the same number of pixels the separation of a pair depends only on
+   *  the difference in pixel index along the rings (the lag) so the sum of
+   *  the products at each lag is a circular cross-correlation which is
+   *  calculated with FFTs.  Every lag is then binned using the bin edges
+   *  \a cosbin (see create_bins()).  The transform of each ring is only
+   *  calculated once.
+   *
+   *  Rings with different numbers of pixels (those involving the polar
+   *  caps) do not share a common set of lags.  For these pairs the bins
+   *  are filled from the cumulative sums, \f$W_e\f$, of the products for
+   *  all pairs with \f$\cos\theta \ge\f$ cosbin[e].  For a pixel in one
+   *  ring the pixels of the other ring satisfying this form a contiguous
+   *  arc, so \f$W_e\f$ is found from the prefix sums along the ring.  Only
+   *  the bin edges within the range of separations of the two rings need
+   *  to be considered.
+   *
+   *  The sum of the map products is returned in \a C2 (not normalized) and
+   *  the number of pairs in each bin in \a Npair, exactly as
+   *  calculate_twopt_function_direct() does.  Each pair is counted once.
+   *  Pairs that lie (to roundoff) on a bin edge may be put in a different
+   *  bin than create_twopt_table would.
+   *
+   *  The cost is of order \f$N_{\rm ring}^2 N_\phi \log N_\phi\f$ for the
+   *  rings outside the polar caps plus \f$N_{\rm ring} N_\phi\f$ times the
+   *  number of bins spanned by a ring pair for the polar caps.  Memory of
+   *  order the size of the map is needed.  Only full sky maps are
+   *  supported.  The map may be in either scheme; a RING ordered copy is
+   *  made if necessary.
+   */
+  void calculate_twopt_function_rings (const Healpix_Map<double>& map_in,
+                                       const std::vector<double>& cosbin,
+                                       std::vector<double>& C2,
+                                       std::vector<size_t>& Npair)
+  {
+    size_t Nbin = cosbin.size() - 1;
+    C2.assign (Nbin, 0);
+    Npair.assign (Nbin, 0);
+    if (Nbin == 0) return;
+
+    Healpix_Map<double> ringmap;
+    const Healpix_Map<double>* mp = &map_in;
+    if (map_in.Scheme() == NEST) {
+      ringmap = map_in;
+      ringmap.swap_scheme();
+      mp = &ringmap;
+    }
+    const Healpix_Map<double>& map = *mp;
+
+    // Ring geometry.  Ring r here is HEALPix ring r+1.
+    int Nring = 4*map.Nside() - 1;
+    std::vector<int> start(Nring), nphi(Nring);
+    std::vector<double> z(Nring), sz(Nring), phi0(Nring);
+    for (int r=0; r < Nring; ++r) {
+      bool shifted;
+      map.get_ring_info (r+1, start[r], nphi[r], z[r], sz[r], shifted);
+      phi0[r] = shifted ? M_PI/nphi[r] : 0;
+    }
+
+    /* Transform of each ring, stored in the same place as the ring pixels,
+     * and the prefix sums of the ring, stored with an extra leading zero
+     * for each ring (so ring r starts at start[r]+r). */
+    std::vector<xcomplex<double> > ringfft (map.Npix());
+    std::vector<double> prefix (map.Npix() + Nring);
+#pragma omp parallel shared(map, start, nphi, ringfft, prefix)
+    {
+      std::tr1::shared_ptr<cfft> plan;
+      int plan_n = 0;
+      arr<xcomplex<double> > buf;
+#pragma omp for schedule(dynamic,1)
+      for (int r=0; r < Nring; ++r) {
+        int n = nphi[r];
+        if (plan_n != n) {
+          plan.reset (new cfft(n));
+          plan_n = n;
+          buf.alloc (n);
+        }
+        for (int j=0; j < n; ++j)
+          buf[j] = xcomplex<double> (map[start[r]+j], 0);
+        plan->forward (buf);
+        for (int j=0; j < n; ++j) ringfft[start[r]+j] = buf[j];
+
+        double *P = &prefix[start[r]+r];
+        P[0] = 0;
+        for (int j=0; j < n; ++j) P[j+1] = P[j] + map[start[r]+j];
+      }
+    }
+
+#pragma omp parallel shared(map, start, nphi, z, sz, phi0, ringfft, \
+                            prefix, C2, Npair)
+    {
+      std::vector<double> Csum (Nbin, 0);
+      std::vector<size_t> Nsum (Nbin, 0);
+      std::vector<double> W (Nbin+1);
+      std::vector<size_t> NW (Nbin+1);
+      std::tr1::shared_ptr<cfft> plan;
+      int plan_n = 0;
+      arr<xcomplex<double> > buf;
+
+#pragma omp for schedule(dynamic,1)
+      for (int r1=0; r1 < Nring; ++r1) {
+        for (int r2=r1; r2 < Nring; ++r2) {
+          double zz = z[r1]*z[r2];
+          double ss = sz[r1]*sz[r2];
+
+          if (nphi[r1] == nphi[r2]) {
+            // Circular cross-correlation with FFTs.
+            int n = nphi[r1];
+            if (plan_n != n) {
+              plan.reset (new cfft(n));
+              plan_n = n;
+              buf.alloc (n);
+            }
+            for (int j=0; j < n; ++j) {
+              buf[j] = std::conj(ringfft[start[r1]+j])
+                * ringfft[start[r2]+j];
+            }
+            plan->backward (buf);
+            /* Within a ring lags d and n-d are the same pairs so only
+             * lags up to n/2 are used.  Lag n/2 counts each pair twice. */
+            int dmin = 0, dmax = n-1;
+            if (r1 == r2) {
+              dmin = 1;
+              dmax = n/2;
+            }
+            for (int d=dmin; d <= dmax; ++d) {
+              double x = zz + ss * std::cos (phi0[r2] - phi0[r1]
+                                             + 2*M_PI*d/n);
+              size_t k = std::upper_bound (cosbin.begin(), cosbin.end(), x)
+                - cosbin.begin() - 1;
+              double c = buf[d].real() / n;
+              size_t Nc = n;
+              if ((r1 == r2) && (2*d == n)) {
+                c *= 0.5;
+                Nc /= 2;
+              }
+              Csum[k] += c;
+              Nsum[k] += Nc;
+            }
+            continue;
+          }
+
+          /* Cumulative sums over arcs.  Loop over the pixels of the
+           * smaller ring, the arcs are in the larger ring. */
+          int ra = r1, rb = r2;
+          if (nphi[ra] > nphi[rb]) std::swap (ra, rb);
+          int na = nphi[ra], nb = nphi[rb];
+          const double *Pb = &prefix[start[rb]+rb];
+          double Atot = prefix[start[ra]+ra+na];
+          for (size_t e=0; e <= Nbin; ++e) {
+            double y = (cosbin[e] - zz) / ss;
+            if (y > 1) {
+              W[e] = 0;
+              NW[e] = 0;
+            } else if (y <= -1) {
+              W[e] = Atot * Pb[nb];
+              NW[e] = na * nb;
+            } else {
+              double w = std::acos(y) * nb / (2*M_PI);
+              double Wsum = 0;
+              size_t Nc = 0;
+              for (int j=0; j < na; ++j) {
+                double u = (phi0[ra] + 2*M_PI*j/na - phi0[rb]) * nb
+                  / (2*M_PI);
+                long lo = static_cast<long>(std::ceil (u - w));
+                long hi = static_cast<long>(std::floor (u + w));
+                double arc;
+                if (hi < lo) continue;
+                if (hi - lo + 1 >= nb) {
+                  arc = Pb[nb];
+                  Nc += nb;
+                } else {
+                  // Shift lo into [0,nb), the arc may wrap around.
+                  long s = ((lo % nb) + nb) % nb;
+                  hi += s - lo;
+                  lo = s;
+                  Nc += hi - lo + 1;
+                  if (hi < nb) arc = Pb[hi+1] - Pb[lo];
+                  else arc = Pb[nb] - Pb[lo] + Pb[hi-nb+1];
+                }
+                Wsum += map[start[ra]+j] * arc;
+              }
+              W[e] = Wsum;
+              NW[e] = Nc;
+            }
+          }
+          for (size_t k=0; k < Nbin; ++k) {
+            Csum[k] += W[k] - W[k+1];
+            Nsum[k] += NW[k] - NW[k+1];
+          }
+        }
+      }
+
+#pragma omp critical
+      {
+        for (size_t k=0; k < Nbin; ++k) {
+          C2[k] += Csum[k];
+          Npair[k] += Nsum[k];
+        }
+      }
+    }
+  }
+}
+
+#endif
+
+/* For emacs, this is a c++ header
+ * Local Variables:
+ * mode: c++
+ * End:
+ */
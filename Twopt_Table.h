@@ -4,9 +4,11 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <stdint.h> // For uint64_t
 #include <tr1/memory> // For std::tr1::shared_ptr
 
 #include <healpix_base.h> // For Healpix_Ordering_Scheme
+#include <healpix_map.h>
 
 #if defined(USE_NO_COMPRESSION)
 #  include <No_Compression_Wrapper.h>
@@ -64,6 +66,11 @@ namespace Npoint_Functions {
    *  uncompressed files are quite large so io becomes a major bottle neck
    *  for any calculation using the two point tables. Hence the choice of
    *  zlib  as the default.
+   *
+   *  For finding triangles a table may be read with a bitmap of each row
+   *  (see read_file() and has_bitmap()).  It is only built when the rows
+   *  are dense, Nmax()*32 >= Npix(), so the bitmap takes no more memory
+   *  than the table itself and rows are intersected a word at a time.
    */
   template<typename T>
   class Twopt_Table : private
@@ -80,6 +87,8 @@ namespace Npoint_Functions {
     std::vector<std::vector<T> > table_write;
     // The read table is a known size.
     std::tr1::shared_ptr<T> table_read;
+    // Optional bitmap of the read table, bitmap_words() words per row.
+    std::vector<uint64_t> bitmap;
     std::vector<T> pixlist;
     double cosbin;
     size_t nside, nmax;
@@ -154,14 +163,15 @@ namespace Npoint_Functions {
      */
     //@{
     /// Generic constructor.
-    Twopt_Table () : table_write(), table_read(), pixlist(), cosbin(0),
+    Twopt_Table () : table_write(), table_read(), bitmap(), pixlist(),
+                     cosbin(0),
                      nside(0), nmax(0), scheme(NEST) {} 
     /** Construct and initialize a table given the pixel list and the
      *  values of the bins.
      */
     Twopt_Table (size_t Nside, const std::vector<T>& pl,
                  double binvalue, Healpix_Ordering_Scheme s=NEST)
-      : table_write(pl.size()), table_read(), pixlist(pl),
+      : table_write(pl.size()), table_read(), bitmap(), pixlist(pl),
         cosbin(binvalue), nside(Nside), nmax(0), scheme(s) {}
     //@}
 
@@ -221,9 +231,11 @@ namespace Npoint_Functions {
 
     /** Read the table from a binary file.
      *  At present version 3 of the file format is supported.  See
-     *  write_file() for details.
+     *  write_file() for details.  If \a with_bitmap is true and the rows
+     *  are dense the bitmap is also built, see build_bitmap().  This is
+     *  only useful when the table will be used to find triangles.
      */
-    bool read_file (const std::string& filename)
+    bool read_file (const std::string& filename, bool with_bitmap=false)
     {
       char version;
       bool status;
@@ -241,9 +253,37 @@ namespace Npoint_Functions {
       }
 
       in.close();
+
+      if (status && with_bitmap && (Nmax()*32 >= Npix())) {
+        build_bitmap();
+      } else {
+        clear_bitmap();
+      }
       return status;
     }
 
+    /** Build the bitmap of the read table.
+     *  Bit \a j of row \a i is set when \a j is in row \a i of the
+     *  table.  This is done by read_file() for dense tables when asked
+     *  but may be called for any table that has been read.
+     */
+    void build_bitmap ()
+    {
+      size_t Nw = bitmap_words();
+      bitmap.assign (Npix()*Nw, 0);
+      T j;
+      for (size_t i=0; i < Npix(); ++i) {
+        uint64_t* row = &bitmap[i*Nw];
+        for (size_t k=0; (k < Nmax()) && ((j = (*this)(i,k)) != -1); ++k) {
+          row[j/64] |= (uint64_t(1) << (j%64));
+        }
+      }
+    }
+
+    /// Free the memory used by the bitmap.
+    inline void clear_bitmap ()
+    { std::vector<uint64_t>().swap (bitmap); }
+
     /** Read the table header from a binary file.
      *  Only the header is read, not the table.  This is useful for getting
      *  information about the two point tables, such as the pixels in them,
@@ -300,6 +340,15 @@ namespace Npoint_Functions {
      */
     inline const T& operator() (T i, T j) const
     { return table_read.get()[i*Nmax()+j]; }
+    /// Is the bitmap of the read table available?
+    inline bool has_bitmap () const { return (! bitmap.empty()); }
+    /// The number of 64 bit words in each row of the bitmap.
+    inline size_t bitmap_words () const { return (Npix()+63)/64; }
+    /** A row of the bitmap.
+     *  Only valid if has_bitmap() is true.
+     */
+    inline const uint64_t* bitmap_row (T i) const
+    { return &bitmap[i*bitmap_words()]; }
     //@}
 
     /// Assign the value of the bin.
@@ -311,6 +360,131 @@ namespace Npoint_Functions {
       std::copy (pl.begin(), pl.end(), pixlist.begin());
     }
   };
+
+  /** Calculate the two point function for one bin.
+   *  Use a Twopt_Table to calculate the two point function for the
+   *  provided HEALPix map.  It is \b assumed that the scheme of the map is
+   *  the same as that of the table.  Each pair of pixels is counted once.
+   *
+   *  \relates Twopt_Table
+   */
+  template<typename TM, typename T>
+  TM calculate_twopt_function (const Healpix_Map<TM>& map,
+                               const Twopt_Table<T>& table)
+  {
+    size_t Npair = 0;
+    TM C2 = 0, Csum;
+    T p1, p2;
+    for (size_t i=0; i < table.Npix(); ++i) {
+      Csum = 0;
+      p1 = table.pixel_list(i);
+      for (size_t j=0; ((j < table.Nmax()) && (table(i,j) != -1)); ++j) {
+        p2 = table.pixel_list(table(i,j));
+        if (p1 > p2) continue; // Avoid double counting.
+        ++Npair;
+        Csum += map[p2];
+      }
+      C2 += map[p1] * Csum;
+    }
+    if (Npair > 0) C2 /= Npair;
+    return C2;
+  }
+
+  /** Calculate all auto and cross two point functions for one bin.
+   *  This is the multi-field version of calculate_twopt_function().  The
+   *  \a K fields are stored in pixel major order in \a fields (see
+   *  make_pixel_major()) so each pixel lookup fetches all fields at once.
+   *  On return \a C2 is the symmetric \a K x \a K matrix (row major) of
+   *  \f$\langle m_a m_b\rangle\f$ for all fields.  The table is traversed
+   *  only once for all the fields.
+   *
+   *  \relates Twopt_Table
+   */
+  template<typename TM, typename T>
+  void calculate_twopt_cross_function (const std::vector<TM>& fields,
+                                       size_t K,
+                                       const Twopt_Table<T>& table,
+                                       std::vector<TM>& C2)
+  {
+    C2.assign (K*K, 0);
+    std::vector<TM> Csum (K);
+    size_t Npair = 0;
+    T p1, p2;
+    const TM *f1, *f2;
+    for (size_t i=0; i < table.Npix(); ++i) {
+      std::fill (Csum.begin(), Csum.end(), 0);
+      p1 = table.pixel_list(i);
+      for (size_t j=0; ((j < table.Nmax()) && (table(i,j) != -1)); ++j) {
+        p2 = table.pixel_list(table(i,j));
+        if (p1 > p2) continue; // Avoid double counting.
+        ++Npair;
+        f2 = &fields[p2*K];
+        for (size_t b=0; b < K; ++b) Csum[b] += f2[b];
+      }
+      f1 = &fields[p1*K];
+      for (size_t a=0; a < K; ++a) {
+        for (size_t b=0; b < K; ++b) C2[a*K+b] += f1[a] * Csum[b];
+      }
+    }
+    // Only one ordering of each pair was used so symmetrize.
+    for (size_t a=0; a < K; ++a) {
+      for (size_t b=a; b < K; ++b) {
+        C2[a*K+b] = C2[b*K+a] = 0.5 * (C2[a*K+b] + C2[b*K+a]);
+      }
+    }
+    if (Npair > 0) {
+      for (size_t j=0; j < C2.size(); ++j) C2[j] /= Npair;
+    }
+  }
+
+  /** Calculate the weighted two point function for one bin.
+   *  This is the same as calculate_twopt_function() except each pixel
+   *  carries a weight, so
+   *  \f[ C = \frac{\sum w_i w_j m_i m_j}{\sum w_i w_j}, \f]
+   *  where the sums are over the pairs in the table.  A mask is just a
+   *  weight map of zeros and ones, so a single full sky table can be used
+   *  with any mask or weighting scheme.  The numerator and the pair weight
+   *  normalization are accumulated together in the same traversal of each
+   *  row.
+   *
+   *  The pixels with non-zero weight are held in a bitset and rows for
+   *  pixels with zero weight are skipped entirely.  Within a row there is
+   *  no branching, zero weight pixels simply contribute nothing.  Every
+   *  pair appears twice in the table (once in each row) and both are
+   *  summed; the factor of two cancels in the ratio.  It is \b assumed
+   *  that the scheme of the map and weights are the same as that of the
+   *  table.
+   *
+   *  \relates Twopt_Table
+   */
+  template<typename TM, typename T>
+  TM calculate_weighted_twopt_function (const Healpix_Map<TM>& map,
+                                        const Healpix_Map<TM>& weight,
+                                        const Twopt_Table<T>& table)
+  {
+    // Weighted map values and weights by table index.
+    std::vector<TM> wm (table.Npix()), w (table.Npix());
+    std::vector<bool> have_weight (table.Npix());
+    for (size_t i=0; i < table.Npix(); ++i) {
+      w[i] = weight[table.pixel_list(i)];
+      wm[i] = w[i] * map[table.pixel_list(i)];
+      have_weight[i] = (w[i] != 0);
+    }
+
+    TM C2 = 0, W2 = 0, Csum, Wsum;
+    for (size_t i=0; i < table.Npix(); ++i) {
+      if (! have_weight[i]) continue;
+      Csum = Wsum = 0;
+      for (size_t j=0; ((j < table.Nmax()) && (table(i,j) != -1)); ++j) {
+        Csum += wm[table(i,j)];
+        Wsum += w[table(i,j)];
+      }
+      C2 += wm[i] * Csum;
+      W2 += w[i] * Wsum;
+    }
+    if (W2 != 0) C2 /= W2;
+    return C2;
+  }
 }
 
 #endif
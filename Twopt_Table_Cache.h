@@ -0,0 +1,150 @@
+#ifndef TWOPT_TABLE_CACHE_H
+#define TWOPT_TABLE_CACHE_H
+
+#include <vector>
+#include <string>
+#include <list>
+#include <iostream>
+#include <cstdlib>
+#include <tr1/memory> // For std::tr1::shared_ptr
+
+#include <Twopt_Table.h>
+
+namespace {
+  /// @cond IDTAG
+  const std::string TWOPT_TABLE_CACHE_RCSID
+  ("$Id$");
+  /// @endcond
+}
+
+namespace Npoint_Functions {
+  /** Memory bounded cache of two point tables.
+   *
+   *  Reading a two point table means decompressing it which is far more
+   *  expensive than using it once for a three point configuration.  The
+   *  cache keeps the most recently used tables from a list of files in
+   *  memory and discards the least recently used ones when the total size
+   *  would exceed the maximum.  The tables are handed out as shared
+   *  pointers so a discarded table stays valid for as long as it is in
+   *  use.  Thus the memory bound is exceeded by at most the tables being
+   *  used by other threads.
+   *
+   *  The cache may be shared between threads.  Only the bookkeeping is
+   *  done in a critical section, tables are read in parallel.  If two
+   *  threads ask for the same missing table at the same time both read it
+   *  and only one copy is kept.
+   */
+  template<typename T>
+  class Twopt_Table_Cache {
+  public :
+    typedef std::tr1::shared_ptr<const Twopt_Table<T> > table_ptr;
+  private :
+    std::vector<std::string> files;
+    std::vector<table_ptr> tables;
+    std::vector<size_t> Nread;
+    // Indices of the tables in memory, most recently used first.
+    std::list<size_t> lru;
+    size_t max_bytes, bytes;
+    bool with_bitmap;
+
+    /// Memory used by a table read from a file.
+    static size_t table_bytes (const Twopt_Table<T>& t)
+    {
+      size_t b = (t.Nmax() + 1) * t.Npix() * sizeof(T);
+      if (t.has_bitmap()) b += t.Npix() * t.bitmap_words() * sizeof(uint64_t);
+      return b;
+    }
+
+    /// Move table \a k to the front of the list, must be in the list.
+    void touch (size_t k)
+    {
+      for (std::list<size_t>::iterator it=lru.begin(); it != lru.end(); ++it)
+        if (*it == k) {
+          lru.splice (lru.begin(), lru, it);
+          break;
+        }
+    }
+
+    /// Discard tables until \a b more bytes fit (or the cache is empty).
+    void make_room (size_t b)
+    {
+      while ((! lru.empty()) && (bytes + b > max_bytes)) {
+        size_t k = lru.back();
+        lru.pop_back();
+        bytes -= table_bytes (*tables[k]);
+        tables[k].reset();
+      }
+    }
+  public :
+    /** Construct a cache for the tables in \a files using at most \a
+     *  max_bytes_ bytes.  A table larger than the maximum is still read
+     *  but is the only table in the cache.  If \a with_bitmap_ is true
+     *  the tables are read with their bitmaps for finding triangles, see
+     *  Twopt_Table::read_file().
+     */
+    Twopt_Table_Cache (const std::vector<std::string>& files_,
+                       size_t max_bytes_, bool with_bitmap_=false)
+      : files(files_), tables(files_.size()), Nread(files_.size(), 0),
+        lru(), max_bytes(max_bytes_), bytes(0), with_bitmap(with_bitmap_) {}
+
+    /** The table for file \a k.
+     *  The table is read if it is not in the cache.  Failing to read a
+     *  table is fatal.
+     */
+    table_ptr get (size_t k)
+    {
+      table_ptr t;
+#pragma omp critical(twopt_table_cache)
+      {
+        if (tables[k]) {
+          t = tables[k];
+          touch (k);
+        }
+      }
+      if (t) return t;
+
+      std::tr1::shared_ptr<Twopt_Table<T> > tnew (new Twopt_Table<T>);
+      if (! tnew->read_file (files[k], with_bitmap)) {
+        std::cerr << "Failed reading two point table " << files[k]
+                  << std::endl;
+        std::exit(1);
+      }
+#pragma omp critical(twopt_table_cache)
+      {
+        ++Nread[k];
+        if (tables[k]) {
+          // Another thread read it first, use that one.
+          t = tables[k];
+          touch (k);
+        } else {
+          t = tnew;
+          make_room (table_bytes (*t));
+          tables[k] = t;
+          lru.push_front (k);
+          bytes += table_bytes (*t);
+        }
+      }
+      return t;
+    }
+
+    /// \name Accessors
+    //@{
+    /// The number of tables.
+    inline size_t size () const { return files.size(); }
+    /// The file for table \a k.
+    inline const std::string& file (size_t k) const { return files[k]; }
+    /// The number of times table \a k has been read.
+    inline size_t reads (size_t k) const { return Nread[k]; }
+    /// The memory used by the tables in the cache.
+    inline size_t memory () const { return bytes; }
+    //@}
+  };
+}
+
+#endif
+
+/* For emacs, this is a c++ header
+ * Local Variables:
+ * mode: c++
+ * End:
+ */
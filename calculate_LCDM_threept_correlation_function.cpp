@@ -0,0 +1,193 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <cmath>
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+#include <alm.h>
+#include <alm_healpix_tools.h>
+#include <alm_powspec_tools.h>
+#include <powspec.h>
+#include <powspec_fitsio.h>
+#include <planck_rng.h>
+
+#include <Twopt_Table.h>
+#include <Pixel_Triangles.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_LCDM_THREEPT_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <cl fits file>"
+            << " <twopt tables prefix> <num maps to generate>\n"
+            << "       " << progname << " -r <file listing map fits files>"
+            << " <twopt tables prefix>\n"
+            << " The equilateral three point function is calculated for"
+            << " all the maps at once,\n"
+            << " finding the triangles in each bin only once.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if (argc != 4) usage (argv[0]);
+  bool read_maps = (std::string(argv[1]) == "-r");
+  std::string twopt_prefix = (read_maps ? argv[3] : argv[2]);
+  size_t Nmaps = 0;
+  std::vector<std::string> map_files;
+  if (read_maps) {
+    std::ifstream in (argv[2]);
+    if (! in.is_open()) {
+      std::cerr << "Failed reading " << argv[2] << std::endl;
+      std::exit(1);
+    }
+    std::string line;
+    while (in.good()) {
+      std::getline (in, line);
+      line = trim (line);
+      if ((line == "") || (line[0] == '#')) continue;
+      map_files.push_back (line);
+    }
+    Nmaps = map_files.size();
+  } else if (! Npoint_Functions::from_string (argv[3], Nmaps)) {
+    std::cerr << "Could not parse Nmaps\n";
+    usage (argv[0]);
+  }
+  if (Nmaps == 0) {
+    std::cerr << "No maps to use!\n";
+    usage (argv[0]);
+  }
+
+  // Figure out how many bins there are by trying to open files.
+  std::vector<std::string> twopt_table_file
+    = Npoint_Functions::get_sequential_file_list (twopt_prefix);
+  if (twopt_table_file.size() == 0) {
+    std::cerr << "No two point table files found!\n";
+    usage (argv[0]);
+  }
+
+  size_t Nside;
+  Healpix_Ordering_Scheme tp_scheme;
+  {
+    Npoint_Functions::Twopt_Table<int> tp;
+    tp.read_file_header (twopt_table_file[0]);
+    Nside = tp.Nside();
+    tp_scheme = tp.Scheme();
+  }
+
+  std::vector<Healpix_Map<double> > maps (Nmaps);
+  if (read_maps) {
+    for (size_t j=0; j < maps.size(); ++j) {
+      read_Healpix_map_from_fits (map_files[j], maps[j]);
+      if (static_cast<size_t>(maps[j].Nside()) != Nside) {
+        std::cerr << "Map " << map_files[j] << " has Nside = "
+                  << maps[j].Nside() << " but the two point tables have"
+                  << " Nside = " << Nside << std::endl;
+        std::exit(1);
+      }
+      if (maps[j].Scheme() != tp_scheme) maps[j].swap_scheme();
+    }
+  } else {
+    std::string clfile = argv[1];
+    int Lmax = std::min (2000UL, 4*Nside+1);
+    for (size_t j=0; j < maps.size(); ++j) {
+      // alm2map REQUIRES the map to be in RING order.
+      maps[j].SetNside (Nside, RING);
+    }
+    PowSpec cl;
+    read_powspec_from_fits (clfile, cl, 1, Lmax);
+
+    // Make the maps
+#pragma omp parallel shared(cl, maps)
+    {
+      planck_rng rng;
+      /* Seed with random values.  Make sure the threads don't stomp on
+       * each other by making the seeding section critical. */
+#pragma omp critical
+      {
+        unsigned int seed[4];
+        std::ifstream inseed ("/dev/urandom",
+                              std::fstream::in | std::fstream::binary);
+        inseed.read (reinterpret_cast<char*>(seed), sizeof(seed));
+        inseed.close();
+        rng.seed (seed[0], seed[1], seed[2], seed[3]);
+      }
+      Alm<xcomplex<double> > alm (cl.Lmax(), cl.Lmax());
+#pragma omp for schedule(static)
+      for (size_t k=0; k < maps.size(); ++k) {
+        create_alm (cl, alm, rng);
+        alm2map (alm, maps[k]);
+        if (maps[k].Scheme() != tp_scheme) maps[k].swap_scheme();
+      }
+    }
+  }
+
+  /* All values at a pixel are fetched together so store the maps in
+   * pixel major order.  The maps themselves are no longer needed. */
+  std::vector<double> fields;
+  Npoint_Functions::make_pixel_major (maps, fields);
+  std::vector<Healpix_Map<double> >().swap (maps);
+
+  std::vector<double> bin_list(twopt_table_file.size());
+  /* We will generate this by bin for each map so make the bin number the
+   * first index. */
+  std::vector<std::vector<double> > Corr(twopt_table_file.size());
+
+  /* With fewer bins than threads the bins are done one at a time, each
+   * split over the threads. */
+  bool bin_threads
+    = Npoint_Functions::parallel_over_bins (twopt_table_file.size());
+
+#pragma omp parallel if(bin_threads) shared(Corr, bin_list, twopt_table_file, fields)
+  {
+    Npoint_Functions::Twopt_Table<int> twopt_table;
+    Npoint_Functions::Threepoint_List_Kernel<double, int>
+      kernel (fields, Nmaps, twopt_table);
+
+#pragma omp for schedule(guided)
+    for (size_t k=0; k < twopt_table_file.size(); ++k) {
+      if (! twopt_table.read_file (twopt_table_file[k], true)) {
+        std::cerr << "Failed reading two point table "
+                  << twopt_table_file[k] << std::endl;
+        std::exit(1);
+      }
+      // Sum the products as the triangles are found, none are stored.
+      kernel.reset();
+      Npoint_Functions::visit_in_blocks
+        (Npoint_Functions::Equilateral_Finder<int> (twopt_table),
+         twopt_table, kernel);
+      bin_list[k] = twopt_table.bin_value();
+      kernel.values (Corr[k]);
+    }
+  }
+
+  std::cout << "# LCDM equilateral three point function from "
+            << twopt_prefix << std::endl;
+  std::cout << "# First line is bin values (theta), rest are the three point"
+            << " function.\n";
+  for (size_t k=0; k < bin_list.size(); ++k) {
+    std::cout << std::acos(bin_list[k]) << " ";
+  }
+  std::cout << std::endl;
+
+  for (size_t j=0; j < Nmaps; ++j) {
+    for (size_t k=0; k < bin_list.size(); ++k) {
+      std::cout << Corr[k][j] << " ";
+    }
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
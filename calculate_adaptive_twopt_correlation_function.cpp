@@ -0,0 +1,189 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+
+#include <Twopt_Table.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_ADAPTIVE_TWOPT_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <map fits file> "
+            << "<full resolution twopt tables prefix>\n"
+            << "         <coarse twopt tables prefix> <switch angle (deg)>"
+            << " [<mask or weight fits file>]\n"
+            << " Bins with angles below the switch angle use the map and"
+            << " the full resolution\n"
+            << " tables.  Bins at or above the switch angle use the map"
+            << " degraded to the Nside\n"
+            << " of the coarse tables.  The coarse map is the average of"
+            << " the full resolution\n"
+            << " pixels in each coarse pixel so it is smoothed by the"
+            << " coarse pixel window.\n"
+            << " The relative error this introduces in a bin at angle theta"
+            << " is roughly\n"
+            << " (theta_pix/theta)^2, with theta_pix ~ 58.6 deg/Nside the"
+            << " coarse pixel size.\n"
+            << " Choose the switch angle to be several coarse pixels for"
+            << " percent level\n"
+            << " agreement.  The cost of the large angle bins drops by"
+            << " about the square of\n"
+            << " the ratio of the Nsides.\n";
+  exit (1);
+}
+
+
+// Headers of two point tables with their bin values.
+void read_table_headers (const std::string& prefix,
+                         std::vector<std::string>& files,
+                         std::vector<double>& bin_list, size_t& Nside)
+{
+  files = Npoint_Functions::get_sequential_file_list (prefix);
+  bin_list.resize (files.size());
+  Npoint_Functions::Twopt_Table<int> tp;
+  Nside = 0;
+  for (size_t k=0; k < files.size(); ++k) {
+    if (! tp.read_file_header (files[k])) {
+      std::cerr << "Error reading two point table " << files[k]
+                << std::endl;
+      std::exit(1);
+    }
+    bin_list[k] = tp.bin_value();
+    Nside = tp.Nside();
+  }
+}
+
+
+int main (int argc, char *argv[])
+{
+  if ((argc < 5) || (argc > 6)) usage (argv[0]);
+  std::string mapfile = argv[1];
+  std::string fine_prefix = argv[2];
+  std::string coarse_prefix = argv[3];
+  double switch_angle;
+  if (! Npoint_Functions::from_string (argv[4], switch_angle)) {
+    std::cerr << "Could not parse the switch angle\n";
+    usage (argv[0]);
+  }
+  double switch_cos = std::cos (switch_angle*M_PI/180);
+
+  std::vector<std::string> fine_files, coarse_files;
+  std::vector<double> fine_bins, coarse_bins;
+  size_t fine_Nside, coarse_Nside;
+  read_table_headers (fine_prefix, fine_files, fine_bins, fine_Nside);
+  read_table_headers (coarse_prefix, coarse_files, coarse_bins,
+                      coarse_Nside);
+  if ((fine_files.size() == 0) || (coarse_files.size() == 0)) {
+    std::cerr << "No two point tables found!\n";
+    usage (argv[0]);
+  }
+  if (coarse_Nside >= fine_Nside) {
+    std::cerr << "The coarse tables must have a smaller Nside than the"
+              << " full resolution tables: " << coarse_Nside << " >= "
+              << fine_Nside << std::endl;
+    std::exit(1);
+  }
+
+  Healpix_Map<double> map;
+  read_Healpix_map_from_fits (mapfile, map);
+  if (map.Scheme() == RING) map.swap_scheme();
+  if (static_cast<size_t>(map.Nside()) != fine_Nside) {
+    std::cerr << "Map and full resolution tables do not have the same"
+              << " Nside: " << map.Nside() << " != " << fine_Nside
+              << std::endl;
+    std::exit(1);
+  }
+  bool have_weight = false;
+  Healpix_Map<double> weight;
+  if (argc == 6) {
+    read_Healpix_map_from_fits (argv[5], weight);
+    if (weight.Scheme() == RING) weight.swap_scheme();
+    if (weight.Nside() != map.Nside()) {
+      std::cerr << "Map and weights do not have the same Nside: "
+                << map.Nside() << " != " << weight.Nside() << std::endl;
+      std::exit(1);
+    }
+    have_weight = true;
+  }
+
+  /* The coarse map.  With weights the weighted map is degraded and
+   * divided by the degraded weights so the coarse weights are the
+   * fraction of the weight in each coarse pixel. */
+  Healpix_Map<double> coarse_map (coarse_Nside, NEST, SET_NSIDE);
+  Healpix_Map<double> coarse_weight;
+  if (have_weight) {
+    Healpix_Map<double> wmap (map);
+    for (int p=0; p < wmap.Npix(); ++p) wmap[p] *= weight[p];
+    coarse_map.Import_degrade (wmap);
+    coarse_weight.SetNside (coarse_Nside, NEST);
+    coarse_weight.Import_degrade (weight);
+    for (int p=0; p < coarse_map.Npix(); ++p) {
+      if (coarse_weight[p] != 0) coarse_map[p] /= coarse_weight[p];
+    }
+  } else {
+    coarse_map.Import_degrade (map);
+  }
+
+  // The bins to use from each set of tables.
+  std::vector<std::string> files;
+  std::vector<bool> use_coarse;
+  for (size_t k=0; k < fine_files.size(); ++k) {
+    if (fine_bins[k] > switch_cos) {
+      files.push_back (fine_files[k]);
+      use_coarse.push_back (false);
+    }
+  }
+  for (size_t k=0; k < coarse_files.size(); ++k) {
+    if (coarse_bins[k] <= switch_cos) {
+      files.push_back (coarse_files[k]);
+      use_coarse.push_back (true);
+    }
+  }
+
+  std::vector<double> bin_list(files.size());
+  std::vector<double> Corr(files.size());
+
+#pragma omp parallel shared(Corr, bin_list, files, use_coarse, map, weight, \
+                            coarse_map, coarse_weight)
+  {
+    Npoint_Functions::Twopt_Table<int> twopt_table;
+#pragma omp for schedule(guided)
+    for (size_t k=0; k < files.size(); ++k) {
+      twopt_table.read_file (files[k]);
+      const Healpix_Map<double>& m = use_coarse[k] ? coarse_map : map;
+      const Healpix_Map<double>& w = use_coarse[k] ? coarse_weight : weight;
+      if (have_weight) {
+        Corr[k] = Npoint_Functions::calculate_weighted_twopt_function
+          (m, w, twopt_table);
+      } else {
+        Corr[k] = Npoint_Functions::calculate_twopt_function
+          (m, twopt_table);
+      }
+      bin_list[k] = twopt_table.bin_value();
+    }
+  }
+
+  // Output in order of increasing angle, decreasing cos(theta).
+  std::vector<std::pair<double,double> > output (files.size());
+  for (size_t k=0; k < files.size(); ++k) {
+    output[k] = std::make_pair (-bin_list[k], Corr[k]);
+  }
+  std::sort (output.begin(), output.end());
+  for (size_t k=0; k < output.size(); ++k) {
+    // Same format as spice
+    std::cout << std::acos(-output[k].first) << " " << -output[k].first
+              << " " << output[k].second << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_CL_FROM_TWOPT_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <twopt correlation function file>"
+            << " [<lmax>]\n"
+            << " The correlation function file is in the format written by"
+            << " the two point\n"
+            << " drivers (theta cos(theta) C) for tables created with"
+            << " gauss_legendre_lmax set.\n"
+            << " The C_l are calculated by Gauss-Legendre quadrature,\n"
+            << "   C_l = 2 pi sum_i w_i C(x_i) P_l(x_i),\n"
+            << " and written as l C_l.  By default lmax is one less than"
+            << " the number of bins,\n"
+            << " the largest value for which the quadrature is exact.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if ((argc < 2) || (argc > 3)) usage (argv[0]);
+  std::string infile = argv[1];
+  int Lmax = -1;
+  if ((argc > 2) && (! Npoint_Functions::from_string (argv[2], Lmax))) {
+    std::cerr << "Could not parse lmax\n";
+    usage (argv[0]);
+  }
+
+  // Read (cos(theta), C) pairs, skipping comments.
+  std::vector<std::pair<double,double> > corr;
+  {
+    std::vector<std::vector<double> > rows;
+    if (! Npoint_Functions::read_columns (infile, rows)) {
+      std::cerr << "Failed reading " << infile << std::endl;
+      return 1;
+    }
+    for (size_t i=0; i < rows.size(); ++i) {
+      if (rows[i].size() < 3) {
+        std::cerr << "Expected three columns in " << infile << std::endl;
+        return 1;
+      }
+      corr.push_back (std::make_pair (rows[i][1], rows[i][2]));
+    }
+  }
+  std::sort (corr.begin(), corr.end());
+
+  size_t N = corr.size();
+  if (N == 0) {
+    std::cerr << "No values in " << infile << std::endl;
+    return 1;
+  }
+  if (Lmax < 0) Lmax = N-1;
+  if (static_cast<size_t>(Lmax) > N-1) {
+    std::cerr << "Warning: the quadrature is only exact up to lmax = "
+              << N-1 << std::endl;
+  }
+
+  /* Use the abscissas at full precision, the file only needs to agree to
+   * the precision it was written with. */
+  std::vector<double> x, w;
+  Npoint_Functions::gauss_legendre (N, x, w);
+  for (size_t i=0; i < N; ++i) {
+    if (std::fabs(x[i] - corr[i].first) > 1e-5) {
+      std::cerr << "The bins are not at the Gauss-Legendre abscissas for "
+                << N << " points: " << corr[i].first << " != " << x[i]
+                << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<double> Cl (Lmax+1, 0), P (Lmax+1);
+  for (size_t i=0; i < N; ++i) {
+    double wC = 2*M_PI * w[i] * corr[i].second;
+    Npoint_Functions::legendre_polynomials (x[i], P);
+    for (int l=0; l <= Lmax; ++l) Cl[l] += wC * P[l];
+  }
+
+  for (int l=0; l <= Lmax; ++l) {
+    std::cout << l << " " << Cl[l] << std::endl;
+  }
+
+  return 0;
+}
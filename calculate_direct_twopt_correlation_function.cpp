@@ -0,0 +1,78 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cmath>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+#include <paramfile.h>
+
+#include <Twopt_Direct.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_DIRECT_TWOPT_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <map fits file> "
+            << "<parameter file name>\n"
+            << " The bins are set in the parameter file exactly as for"
+            << " create_twopt_table\n"
+            << " (dcosbin, dtheta, cosbinfile, or gauss_legendre_lmax)."
+            << "  Optionally maskfile\n"
+            << " and tile_size may also be set.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if (argc != 3) usage (argv[0]);
+  std::string mapfile = argv[1];
+
+  paramfile params (argv[2]);
+  std::string maskfile = params.find<std::string> ("maskfile", "");
+  size_t tile_size = params.find<int> ("tile_size", 1024);
+
+  std::vector<double> bin_list, cosbin;
+  if (! Npoint_Functions::create_bins (params, bin_list, cosbin)) return 1;
+
+  Healpix_Map<double> map;
+  read_Healpix_map_from_fits (mapfile, map);
+  if (map.Scheme() == RING) map.swap_scheme();
+
+  std::vector<int> pixel_list;
+  if (maskfile != "") {
+    Healpix_Map<double> mask;
+    read_Healpix_map_from_fits (maskfile, mask);
+    if (mask.Scheme() == RING) mask.swap_scheme();
+    if (mask.Nside() != map.Nside()) {
+      std::cerr << "Map and mask do not have the same Nside: "
+                << map.Nside() << " != " << mask.Nside() << std::endl;
+      return 1;
+    }
+    Npoint_Functions::mask_to_pixlist (mask, pixel_list);
+  } else {
+    pixel_list.resize (map.Npix());
+    std::generate (pixel_list.begin(), pixel_list.end(),
+                   Npoint_Functions::myRange<int>());
+  }
+
+  std::vector<double> Corr;
+  std::vector<size_t> Npair;
+  Npoint_Functions::calculate_twopt_function_direct (map, pixel_list, cosbin,
+                                                     Corr, Npair, tile_size);
+
+  for (size_t k=0; k < bin_list.size(); ++k) {
+    if (Npair[k] > 0) Corr[k] /= Npair[k];
+    // Same format as spice
+    std::cout << std::acos(bin_list[k]) << " " << bin_list[k] << " "
+              << Corr[k] << std::endl;
+  }
+
+  return 0;
+}
@@ -37,29 +37,31 @@ int main (int argc, char *argv[])
   std::vector<double> bin_list(twopt_table_list.size());
   std::vector<double> Corr(twopt_table_list.size());
 
-#pragma omp parallel shared(twopt_table_list, Corr, bin_list)
+  /* With fewer bins than threads the bins are done one at a time, each
+   * split over the threads. */
+  bool bin_threads
+    = Npoint_Functions::parallel_over_bins (twopt_table_list.size());
+
+#pragma omp parallel if(bin_threads) shared(twopt_table_list, Corr, bin_list)
   {
-    double C3;
     Npoint_Functions::Twopt_Table<int> twopt_table;
-    Npoint_Functions::Pixel_Triangles_Equilateral<int> triangles;
+    Npoint_Functions::Threepoint_Kernel<double, int> kernel (map, twopt_table);
 
 #pragma omp for schedule(guided)
     for (size_t k=0; k < twopt_table_list.size(); ++k) {
-      twopt_table.read_file (twopt_table_list[k]);
+      twopt_table.read_file (twopt_table_list[k], true);
       // Cast to quiet the compiler about the signed/unsigned comparison.
       if ((size_t)map.Npix() < twopt_table.Npix()) {
               std::cerr << "Map does not have enough pixels.\n";
         std::exit(1);
       }
-      triangles.find_triangles (twopt_table);
-      C3 = 0;
-      for (size_t j=0; j < triangles.size(); ++j) {
-        C3 += map[triangles.get(j,0)] * map[triangles.get(j,1)]
-          * map[triangles.get(j,2)];
-      }
-      if (triangles.size() != 0) C3 /= triangles.size();
-      bin_list[k] = triangles.lengths()[0];
-      Corr[k] = C3;
+      // Sum the products as the triangles are found, none are stored.
+      kernel.reset();
+      Npoint_Functions::visit_in_blocks
+        (Npoint_Functions::Equilateral_Finder<int> (twopt_table),
+         twopt_table, kernel);
+      bin_list[k] = twopt_table.bin_value();
+      Corr[k] = kernel.value();
     }
   }
 
@@ -0,0 +1,105 @@
+#include <iostream>
+#include <string>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+
+#include <Twopt_Table.h>
+#include <Pixel_Triangles.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_EQUILATERAL_THREEPT_CROSS_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <twopt tables prefix> "
+            << "<map fits file 1> <map fits file 2> [<map fits file 3> ...]\n"
+            << " All auto and cross correlation functions of the maps are"
+            << " calculated.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if (argc < 4) usage (argv[0]);
+  std::string twopt_prefix = argv[1];
+  size_t K = argc - 2;
+
+  std::vector<Healpix_Map<double> > maps (K);
+  for (size_t a=0; a < K; ++a) {
+    read_Healpix_map_from_fits (argv[a+2], maps[a]);
+    if (maps[a].Scheme() == RING) maps[a].swap_scheme();
+    if (maps[a].Nside() != maps[0].Nside()) {
+      std::cerr << "All maps must have the same Nside: "
+                << argv[a+2] << std::endl;
+      std::exit(1);
+    }
+  }
+  int Nside = maps[0].Nside();
+  std::vector<double> fields;
+  Npoint_Functions::make_pixel_major (maps, fields);
+  maps.clear();
+
+  std::vector<std::string> twopt_table_list
+    = Npoint_Functions::get_sequential_file_list (twopt_prefix);
+  if (twopt_table_list.size() == 0) {
+    std::cerr << "No two point table files found!\n";
+    usage (argv[0]);
+  }
+  {
+    Npoint_Functions::Twopt_Table<int> tp;
+    tp.read_file_header (twopt_table_list[0]);
+    if (static_cast<size_t>(Nside) != tp.Nside()) {
+      std::cerr << "Maps and two point tables do not have the same Nside: "
+                << Nside << " != " << tp.Nside() << std::endl;
+      std::exit(1);
+    }
+  }
+  std::vector<double> bin_list(twopt_table_list.size());
+  std::vector<std::vector<double> > Corr(twopt_table_list.size());
+
+#pragma omp parallel shared(twopt_table_list, Corr, bin_list, fields)
+  {
+    Npoint_Functions::Twopt_Table<int> twopt_table;
+    Npoint_Functions::Pixel_Triangles_Equilateral<int> triangles;
+
+#pragma omp for schedule(guided)
+    for (size_t k=0; k < twopt_table_list.size(); ++k) {
+      twopt_table.read_file (twopt_table_list[k], true);
+      triangles.find_triangles (twopt_table);
+      Npoint_Functions::calculate_threepoint_cross_function (fields, K,
+                                                             triangles,
+                                                             Corr[k]);
+      bin_list[k] = triangles.lengths()[0];
+    }
+  }
+
+  std::cout << "# Equilateral three point cross correlation functions from "
+            << twopt_prefix << std::endl;
+  std::cout << "# Columns are theta, cos(theta), then C_abc for"
+            << " a <= b <= c:";
+  for (size_t a=0; a < K; ++a) {
+    for (size_t b=a; b < K; ++b) {
+      for (size_t c=b; c < K; ++c)
+        std::cout << " " << a << "," << b << "," << c;
+    }
+  }
+  std::cout << std::endl;
+  for (size_t k=0; k < bin_list.size(); ++k) {
+    std::cout << std::acos(bin_list[k]) << " " << bin_list[k];
+    for (size_t a=0; a < K; ++a) {
+      for (size_t b=a; b < K; ++b) {
+        for (size_t c=b; c < K; ++c)
+          std::cout << " " << Corr[k][(a*K+b)*K+c];
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cmath>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+#include <alm.h>
+#include <alm_fitsio.h>
+#include <alm_healpix_tools.h>
+#include <alm_powspec_tools.h>
+#include <powspec.h>
+
+#include <Twopt_Table.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_HARMONIC_TWOPT_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <map or alm fits file> "
+            << "<twopt tables prefix> [<lmax> [map|alm]]\n"
+            << " The two point function is calculated from the C_l of the"
+            << " map (or alm) at the\n"
+            << " bin values of the two point tables.  By default lmax is"
+            << " 3*Nside of the tables\n"
+            << " and the fits file is a map.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if ((argc < 3) || (argc > 5)) usage (argv[0]);
+  std::string infile = argv[1];
+  std::string twopt_prefix = argv[2];
+  int Lmax = -1;
+  if ((argc > 3) && (! Npoint_Functions::from_string (argv[3], Lmax))) {
+    std::cerr << "Could not parse lmax\n";
+    usage (argv[0]);
+  }
+  bool input_is_alm = false;
+  if (argc > 4) {
+    std::string intype = argv[4];
+    if (intype == "alm") input_is_alm = true;
+    else if (intype != "map") usage (argv[0]);
+  }
+
+  // Only the headers are needed for the bin values.
+  std::vector<std::string> twopt_table_file
+    = Npoint_Functions::get_sequential_file_list (twopt_prefix);
+  if (twopt_table_file.size() == 0) {
+    std::cerr << "No two point tables found!\n";
+    usage (argv[0]);
+  }
+  std::vector<double> bin_list(twopt_table_file.size());
+  size_t Nside = 0;
+  {
+    Npoint_Functions::Twopt_Table<int> tp;
+    for (size_t k=0; k < twopt_table_file.size(); ++k) {
+      tp.read_file_header (twopt_table_file[k]);
+      bin_list[k] = tp.bin_value();
+      Nside = tp.Nside();
+    }
+  }
+  if (Lmax < 0) Lmax = 3*Nside;
+
+  Alm<xcomplex<double> > alm (Lmax, Lmax);
+  if (input_is_alm) {
+    read_Alm_from_fits (infile, alm, Lmax, Lmax);
+  } else {
+    Healpix_Map<double> map;
+    read_Healpix_map_from_fits (infile, map);
+    /* The default lmax comes from the tables, a map at a different
+     * resolution would give aliased C_l. */
+    if (static_cast<size_t>(map.Nside()) != Nside) {
+      std::cerr << "Map and two point tables do not have the same Nside: "
+                << map.Nside() << " != " << Nside << std::endl;
+      std::exit(1);
+    }
+    // map2alm REQUIRES the map to be in RING order.
+    if (map.Scheme() == NEST) map.swap_scheme();
+    arr<double> weight (2*map.Nside(), 1.0);
+    map2alm_iter (map, alm, 3, weight);
+  }
+
+  PowSpec cl;
+  extract_powspec (alm, cl);
+  // Coefficients of the Legendre series, (2l+1)/(4pi) C_l
+  std::vector<double> coeff (Lmax+1);
+  for (int l=0; l <= Lmax; ++l) {
+    coeff[l] = (2*l+1) / (4*M_PI) * cl.tt(l);
+  }
+
+  for (size_t k=0; k < bin_list.size(); ++k) {
+    // Same format as spice
+    std::cout << std::acos(bin_list[k]) << " " << bin_list[k] << " "
+              << Npoint_Functions::legendre_series (coeff, bin_list[k])
+              << std::endl;
+  }
+
+  return 0;
+}
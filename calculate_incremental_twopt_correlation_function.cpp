@@ -0,0 +1,107 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+
+#include <Twopt_Incremental.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_INCREMENTAL_TWOPT_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <map fits file> "
+            << "<twopt tables prefix> <pixel changes file>\n"
+            << "The pixel changes file has lines of \"pixel value\" with the\n"
+            << "pixel numbers in the ordering of the two point tables.  Blank\n"
+            << "lines separate the changes into updates and anything\n"
+            << "following a # is a comment.  The two point function is\n"
+            << "printed for the initial map and after each update.\n";
+  exit (1);
+}
+
+
+// Print the two point function in the same format as spice.
+void print_correlation
+(const Npoint_Functions::Twopt_Incremental<int>& twopt)
+{
+  for (size_t k=0; k < twopt.Nbin(); ++k) {
+    std::cout << std::acos(twopt.bin_value(k)) << " "
+              << twopt.bin_value(k) << " "
+              << twopt.correlation(k) << std::endl;
+  }
+}
+
+
+int main (int argc, char *argv[])
+{
+  if (argc != 4) usage (argv[0]);
+  std::string mapfile = argv[1];
+  std::string twopt_prefix = argv[2];
+  std::string changefile = argv[3];
+
+  Healpix_Map<double> map;
+  read_Healpix_map_from_fits (mapfile, map);
+
+  // Figure out how many bins there are by trying to open files.
+  std::vector<std::string> twopt_table_file
+    = Npoint_Functions::get_sequential_file_list (twopt_prefix);
+  if (twopt_table_file.size() == 0) {
+    std::cerr << "No two point table files found!\n";
+    usage (argv[0]);
+  }
+
+  Npoint_Functions::Twopt_Incremental<int> twopt;
+  if (! twopt.initialize (map, twopt_table_file)) std::exit(1);
+  print_correlation (twopt);
+
+  std::ifstream in (changefile.c_str());
+  if (! in.is_open()) {
+    std::cerr << "Failed reading " << changefile << std::endl;
+    std::exit(1);
+  }
+  std::vector<int> pixels;
+  std::vector<double> values, vals;
+  std::string line;
+  std::string::iterator it;
+  bool blank;
+  while (in.good()) {
+    std::getline (in, line);
+    line = trim (line);
+    blank = (line == "");
+    it = std::find (line.begin(), line.end(), '#');
+    if (it != line.end()) line.erase (it, line.end());
+    line = trim (line);
+    if (line != "") {
+      vals.clear();
+      split (line, vals);
+      if (vals.size() != 2) {
+        std::cerr << "Could not parse pixel change: " << line << std::endl;
+        std::exit(1);
+      }
+      pixels.push_back (static_cast<int>(vals[0]));
+      values.push_back (vals[1]);
+    }
+    // A blank line or the end of the file finishes an update.
+    if ((blank || (! in.good())) && (pixels.size() > 0)) {
+      twopt.update (pixels, values);
+      pixels.clear();
+      values.clear();
+      std::cout << std::endl;
+      print_correlation (twopt);
+    }
+  }
+  in.close();
+
+  return 0;
+}
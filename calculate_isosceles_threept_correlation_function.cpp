@@ -1,6 +1,7 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <algorithm>
 
 #include <healpix_map.h>
 #include <healpix_map_fitsio.h>
@@ -19,7 +20,14 @@ void usage (const char *progname)
 {
   std::cerr << "Usage: " << progname << " <map fits file> "
             << "<twopt tables prefix> <length of equal sides (deg)>\n"
-            << " The closest bin the the side length you specified will be used.\n";
+            << " The closest bin the the side length you specified will be used.\n"
+            << " Several lengths may be given as a comma separated list or"
+            << " as min:max:step.\n"
+            << " Each other table is then read once and the output is a"
+            << " grid with lines of\n"
+            << " the equal side length (radians) followed by the usual"
+            << " columns, with a blank\n"
+            << " line after each equal side length.\n";
   exit (1);
 }
 
@@ -29,15 +37,12 @@ int main (int argc, char *argv[])
   if (argc != 4) usage (argv[0]);
   std::string mapfile = argv[1];
   std::string twopt_prefix = argv[2];
-  double ang;
-  if (! Npoint_Functions::from_string (argv[3], ang)) {
-    std::cerr << "Error converting argument to an angle : " << argv[3]
+  std::vector<double> ang;
+  if (! Npoint_Functions::parse_value_list (argv[3], ang)) {
+    std::cerr << "Error converting argument to angles : " << argv[3]
               << std::endl; 
     usage (argv[0]);
   }
-  double cosbin_equal = std::cos(ang*M_PI/180);
-  double dcosbin = 3;
-  int icosbin = 0;
 
   Healpix_Map<double> map;
   read_Healpix_map_from_fits (mapfile, map);
@@ -46,56 +51,95 @@ int main (int argc, char *argv[])
   // Figure out how many bins there are by trying to open files.
   std::vector<std::string> twopt_table_file
     = Npoint_Functions::get_sequential_file_list(twopt_prefix);
-  // Then loop over them to find the bin we want for the equal length sides.
+  /* Then loop over them to find the bins we want for the equal length
+   * sides.  Each different bin is only stored once. */
+  std::vector<size_t> iequal(ang.size());
+  std::vector<size_t> equal_bins;
   {
     Npoint_Functions::Twopt_Table<int> tp;
+    std::vector<double> cosbin(twopt_table_file.size());
     for (size_t k=0; k < twopt_table_file.size(); ++k) {
       tp.read_file_header (twopt_table_file[k]);
-      if (std::abs(cosbin_equal - tp.bin_value()) < dcosbin) {
-        icosbin = k;
-        dcosbin = std::abs(cosbin_equal - tp.bin_value());
+      cosbin[k] = tp.bin_value();
+    }
+    for (size_t a=0; a < ang.size(); ++a) {
+      double cosbin_equal = std::cos(ang[a]*M_PI/180);
+      double dcosbin = 3;
+      size_t icosbin = 0;
+      for (size_t k=0; k < twopt_table_file.size(); ++k) {
+        if (std::abs(cosbin_equal - cosbin[k]) < dcosbin) {
+          icosbin = k;
+          dcosbin = std::abs(cosbin_equal - cosbin[k]);
+        }
       }
+      std::cerr << "Using file for equal sides: "
+                << twopt_table_file[icosbin] << std::endl;
+      iequal[a] = std::find (equal_bins.begin(), equal_bins.end(), icosbin)
+        - equal_bins.begin();
+      if (iequal[a] == equal_bins.size()) equal_bins.push_back (icosbin);
     }
-    std::cerr << "Using file for equal sides: "
-              << twopt_table_file[icosbin] << std::endl;
   }
+  size_t Nequal = equal_bins.size();
 
   std::vector<double> bin_list(twopt_table_file.size());
-  std::vector<double> Corr(twopt_table_file.size());
+  std::vector<std::vector<double> >
+    Corr(Nequal, std::vector<double>(twopt_table_file.size()));
+
+  // All the equal side tables are kept in memory.
+  std::vector<Npoint_Functions::Twopt_Table<int> >
+    twopt_table_equal(Nequal);
+  for (size_t e=0; e < Nequal; ++e) {
+    twopt_table_equal[e].read_file (twopt_table_file[equal_bins[e]], true);
+  }
 
-  Npoint_Functions::Twopt_Table<int> twopt_table_equal;
-  twopt_table_equal.read_file (twopt_table_file[icosbin]);
+  /* With fewer bins than threads the bins are done one at a time, each
+   * split over the threads. */
+  bool bin_threads
+    = Npoint_Functions::parallel_over_bins (twopt_table_file.size());
 
-#pragma omp parallel shared(Corr, bin_list, twopt_table_equal, twopt_table_file)
+#pragma omp parallel if(bin_threads) shared(Corr, bin_list, twopt_table_equal, twopt_table_file)
   {
-    double C3;
     Npoint_Functions::Twopt_Table<int> twopt_table;
-    Npoint_Functions::Pixel_Triangles_Isosceles<int> triangles;
+    Npoint_Functions::Threepoint_Kernel<double, int> kernel (map, twopt_table);
 
 #pragma omp for schedule(guided)
     for (size_t k=0; k < twopt_table_file.size(); ++k) {
-      twopt_table.read_file (twopt_table_file[k]);
+      twopt_table.read_file (twopt_table_file[k], true);
       // Cast to quiet the compiler about the signed/unsigned comparison.
       if ((size_t)map.Npix() < twopt_table.Npix()) {
               std::cerr << "Map does not have enough pixels.\n";
         std::exit(1);
       }
-      triangles.find_triangles (twopt_table_equal, twopt_table);
-      C3 = 0;
-      for (size_t j=0; j < triangles.size(); ++j) {
-        C3 += map[triangles.get(j,0)] * map[triangles.get(j,1)]
-          * map[triangles.get(j,2)];
+      // Sum the products as the triangles are found, none are stored.
+      for (size_t e=0; e < Nequal; ++e) {
+        kernel.reset();
+        Npoint_Functions::visit_in_blocks
+          (Npoint_Functions::Isosceles_Finder<int> (twopt_table_equal[e],
+                                                    twopt_table),
+           twopt_table, kernel);
+        Corr[e][k] = kernel.value();
       }
-      if (triangles.size() != 0) C3 /= triangles.size();
-      bin_list[k] = triangles.lengths()[0];
-      Corr[k] = C3;
+      bin_list[k] = twopt_table.bin_value();
     }
   }
 
-  for (size_t k=0; k < bin_list.size(); ++k) {
-    // Same format as spice
-    std::cout << std::acos(bin_list[k]) << " " << bin_list[k] << " "
-              << Corr[k] << std::endl;
+  if (ang.size() == 1) {
+    for (size_t k=0; k < bin_list.size(); ++k) {
+      // Same format as spice
+      std::cout << std::acos(bin_list[k]) << " " << bin_list[k] << " "
+                << Corr[0][k] << std::endl;
+    }
+    return 0;
+  }
+
+  for (size_t a=0; a < ang.size(); ++a) {
+    double theta_equal
+      = std::acos(twopt_table_equal[iequal[a]].bin_value());
+    for (size_t k=0; k < bin_list.size(); ++k) {
+      std::cout << theta_equal << " " << std::acos(bin_list[k]) << " "
+                << bin_list[k] << " " << Corr[iequal[a]][k] << std::endl;
+    }
+    std::cout << std::endl;
   }
 
   return 0;
@@ -0,0 +1,189 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+
+#include <Twopt_Table.h>
+#include <Pixel_Triangles.h>
+#include <Quadrilateral_List_File.h>
+#include <Jackknife.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_JACKKNIFE_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <twopt|threept|fourpt> "
+            << "<map fits file> <region map fits file>\n"
+            << "         <twopt tables or quad list prefix>"
+            << " [<output prefix>]\n"
+            << " The region map labels each pixel by its jackknife region"
+            << " (0, 1, ...).\n"
+            << " Pixels with a negative label are not used as the first"
+            << " vertex.\n"
+            << " The three point function uses equilateral triangles.  If"
+            << " an output prefix\n"
+            << " is given the delete-one estimates and the covariance are"
+            << " written to\n"
+            << " <output prefix>delete_one.dat and"
+            << " <output prefix>covariance.dat.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if ((argc < 5) || (argc > 6)) usage (argv[0]);
+  std::string mode = argv[1];
+  std::string mapfile = argv[2];
+  std::string regionfile = argv[3];
+  std::string prefix = argv[4];
+  std::string output_prefix = (argc == 6) ? argv[5] : "";
+  if ((mode != "twopt") && (mode != "threept") && (mode != "fourpt"))
+    usage (argv[0]);
+
+  Healpix_Map<double> map, region_map;
+  read_Healpix_map_from_fits (mapfile, map);
+  read_Healpix_map_from_fits (regionfile, region_map);
+  if (region_map.Nside() != map.Nside()) {
+    std::cerr << "Map and region map do not have the same Nside: "
+              << map.Nside() << " != " << region_map.Nside() << std::endl;
+    std::exit(1);
+  }
+
+  std::vector<std::string> files;
+  Healpix_Ordering_Scheme scheme = NEST;
+  if (mode == "fourpt") {
+    files = Npoint_Functions::get_range_file_list(prefix, 0, 180);
+    if (files.size() > 0) {
+      Npoint_Functions::Quadrilateral_List_File<int> qlf (files[0]);
+      scheme = qlf.Scheme();
+    }
+  } else {
+    files = Npoint_Functions::get_sequential_file_list (prefix);
+  }
+  if (files.size() == 0) {
+    std::cerr << "No files found with prefix " << prefix << std::endl;
+    std::exit(1);
+  }
+  if (map.Scheme() != scheme) map.swap_scheme();
+  if (region_map.Scheme() != scheme) region_map.swap_scheme();
+
+  std::vector<int> region;
+  size_t Nregion = Npoint_Functions::region_list (region_map, region);
+  if (Nregion == 0) {
+    std::cerr << "No regions found in the region map\n";
+    std::exit(1);
+  }
+
+  std::vector<double> bin_list(files.size());
+  std::vector<Npoint_Functions::Jackknife_Sums> sums(files.size());
+
+  /* With fewer three point bins than threads the bins are done one at a
+   * time, each split over the threads. */
+  bool bin_threads = ((mode != "threept")
+                      || Npoint_Functions::parallel_over_bins (files.size()));
+
+#pragma omp parallel if(bin_threads) shared(files, bin_list, sums, map, region)
+  {
+    Npoint_Functions::Twopt_Table<int> twopt_table;
+    Npoint_Functions::Threepoint_Jackknife_Kernel<double, int>
+      kernel (map, region, Nregion, twopt_table);
+    Npoint_Functions::Quadrilateral_List_File<int> qlf;
+
+#pragma omp for schedule(dynamic,1)
+    for (size_t k=0; k < files.size(); ++k) {
+      sums[k].reset (Nregion);
+      if (mode == "fourpt") {
+        if (! qlf.initialize (files[k])) {
+          std::cerr << "Error initializing quadrilateral list from "
+                    << files[k] << std::endl;
+          std::exit(1);
+        }
+        if (static_cast<size_t>(map.Nside()) != qlf.Nside()) {
+          std::cerr << "Map has Nside = " << map.Nside()
+                    << " but quad list has Nside = " << qlf.Nside()
+                    << "\nGiving up!\n";
+          std::exit(1);
+        }
+        Npoint_Functions::calculate_fourpoint_function_jackknife
+          (map, region, qlf, sums[k]);
+        bin_list[k] = qlf.bin_value()*M_PI/180;
+      } else {
+        twopt_table.read_file (files[k], (mode == "threept"));
+        if (static_cast<size_t>(map.Npix()) < twopt_table.Npix()) {
+          std::cerr << "Map does not have enough pixels.\n";
+          std::exit(1);
+        }
+        if (mode == "twopt") {
+          Npoint_Functions::calculate_twopt_function_jackknife
+            (map, region, twopt_table, sums[k]);
+        } else {
+          // Sum the products as the triangles are found, none are stored.
+          kernel.reset();
+          Npoint_Functions::visit_in_blocks
+            (Npoint_Functions::Equilateral_Finder<int> (twopt_table),
+             twopt_table, kernel);
+          sums[k] = kernel.sums();
+        }
+        bin_list[k] = std::acos(twopt_table.bin_value());
+      }
+    }
+  }
+
+  // Only use the regions that contain pixels.
+  std::vector<size_t> used;
+  {
+    std::vector<bool> have_pixel (Nregion, false);
+    for (size_t p=0; p < region.size(); ++p) {
+      if (region[p] >= 0) have_pixel[region[p]] = true;
+    }
+    for (size_t r=0; r < Nregion; ++r) if (have_pixel[r]) used.push_back(r);
+  }
+  std::vector<std::vector<double> > Cdel (files.size());
+  std::vector<double> C;
+  for (size_t k=0; k < files.size(); ++k) {
+    sums[k].delete_one (C);
+    Cdel[k].resize (used.size());
+    for (size_t r=0; r < used.size(); ++r) Cdel[k][r] = C[used[r]];
+  }
+  std::vector<double> cov;
+  Npoint_Functions::jackknife_covariance (Cdel, cov);
+
+  // Same format as spice with the jackknife error as the last column.
+  size_t Nbin = files.size();
+  for (size_t k=0; k < Nbin; ++k) {
+    std::cout << bin_list[k] << " " << std::cos(bin_list[k]) << " "
+              << sums[k].value() << " " << std::sqrt(cov[k*Nbin+k])
+              << std::endl;
+  }
+
+  if (output_prefix != "") {
+    std::ofstream out ((output_prefix + "delete_one.dat").c_str());
+    out << "# Delete-one estimates, one line per region, one column"
+        << " per bin\n";
+    for (size_t r=0; r < used.size(); ++r) {
+      out << used[r];
+      for (size_t k=0; k < Nbin; ++k) out << " " << Cdel[k][r];
+      out << std::endl;
+    }
+    out.close();
+    out.open ((output_prefix + "covariance.dat").c_str());
+    out << "# Jackknife covariance between bins from " << used.size()
+        << " regions\n";
+    for (size_t k=0; k < Nbin; ++k) {
+      for (size_t l=0; l < Nbin; ++l) out << cov[k*Nbin+l] << " ";
+      out << std::endl;
+    }
+    out.close();
+  }
+
+  return 0;
+}
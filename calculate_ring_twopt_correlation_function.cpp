@@ -0,0 +1,58 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cmath>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+#include <paramfile.h>
+
+#include <Twopt_Rings.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_RING_TWOPT_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <map fits file> "
+            << "<parameter file name>\n"
+            << " The two point function of a full sky map is calculated"
+            << " from FFTs of the\n"
+            << " rings of the map.  The bins are set in the parameter file"
+            << " exactly as for\n"
+            << " create_twopt_table (dcosbin, dtheta, cosbinfile, or\n"
+            << " gauss_legendre_lmax).\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if (argc != 3) usage (argv[0]);
+  std::string mapfile = argv[1];
+
+  paramfile params (argv[2]);
+  std::vector<double> bin_list, cosbin;
+  if (! Npoint_Functions::create_bins (params, bin_list, cosbin)) return 1;
+
+  Healpix_Map<double> map;
+  read_Healpix_map_from_fits (mapfile, map);
+  if (map.Scheme() == NEST) map.swap_scheme();
+
+  std::vector<double> Corr;
+  std::vector<size_t> Npair;
+  Npoint_Functions::calculate_twopt_function_rings (map, cosbin, Corr, Npair);
+
+  for (size_t k=0; k < bin_list.size(); ++k) {
+    if (Npair[k] > 0) Corr[k] /= Npair[k];
+    // Same format as spice
+    std::cout << std::acos(bin_list[k]) << " " << bin_list[k] << " "
+              << Corr[k] << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include <iostream>
+#include <string>
+#include <cmath>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+#include <planck_rng.h>
+
+#include <Twopt_Table.h>
+#include <Quadrilateral_List_File.h>
+#include <Sampled_Estimator.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_SAMPLED_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <twopt|threept|fourpt> "
+            << "<map fits file> <twopt tables or quad list prefix>\n"
+            << "         <relative tolerance> [<max time per bin (s)>"
+            << " [<seed>]]\n"
+            << " The npoint function is estimated from randomly sampled"
+            << " table rows,\n"
+            << " equilateral triangle rows, or quadrilateral list records."
+            << "  Sampling stops\n"
+            << " for a bin when the relative standard error is below the"
+            << " tolerance or the\n"
+            << " time budget (0 for none) is used up.  The same seed gives"
+            << " the same result.\n"
+            << " The output columns are theta, cos(theta), the estimate,"
+            << " its standard error,\n"
+            << " and the fraction of the rows or records sampled.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if ((argc < 5) || (argc > 7)) usage (argv[0]);
+  std::string mode = argv[1];
+  std::string mapfile = argv[2];
+  std::string prefix = argv[3];
+  if ((mode != "twopt") && (mode != "threept") && (mode != "fourpt"))
+    usage (argv[0]);
+  double tolerance, max_time = 0;
+  unsigned int seed = 1234;
+  if (! Npoint_Functions::from_string (argv[4], tolerance)) {
+    std::cerr << "Could not parse the tolerance\n";
+    usage (argv[0]);
+  }
+  if ((argc > 5) && (! Npoint_Functions::from_string (argv[5], max_time))) {
+    std::cerr << "Could not parse the time budget\n";
+    usage (argv[0]);
+  }
+  if ((argc > 6) && (! Npoint_Functions::from_string (argv[6], seed))) {
+    std::cerr << "Could not parse the seed\n";
+    usage (argv[0]);
+  }
+
+  Healpix_Map<double> map;
+  read_Healpix_map_from_fits (mapfile, map);
+
+  std::vector<std::string> files;
+  Healpix_Ordering_Scheme scheme = NEST;
+  if (mode == "fourpt") {
+    files = Npoint_Functions::get_range_file_list(prefix, 0, 180);
+    if (files.size() > 0) {
+      Npoint_Functions::Quadrilateral_List_File<int> qlf (files[0]);
+      scheme = qlf.Scheme();
+    }
+  } else {
+    files = Npoint_Functions::get_sequential_file_list (prefix);
+  }
+  if (files.size() == 0) {
+    std::cerr << "No files found with prefix " << prefix << std::endl;
+    std::exit(1);
+  }
+  if (map.Scheme() != scheme) map.swap_scheme();
+
+  std::vector<double> bin_list(files.size());
+  std::vector<Npoint_Functions::Ratio_Estimator> est(files.size());
+
+#pragma omp parallel shared(files, bin_list, est, map)
+  {
+    Npoint_Functions::Twopt_Table<int> twopt_table;
+    Npoint_Functions::Quadrilateral_List_File<int> qlf;
+
+#pragma omp for schedule(dynamic,1)
+    for (size_t k=0; k < files.size(); ++k) {
+      // Each bin has its own stream so the results do not depend on
+      // the order the bins are processed.
+      planck_rng rng (seed, k+1);
+      if (mode == "fourpt") {
+        if (! qlf.initialize (files[k])) {
+          std::cerr << "Error initializing quadrilateral list from "
+                    << files[k] << std::endl;
+          std::exit(1);
+        }
+        if (static_cast<size_t>(map.Nside()) != qlf.Nside()) {
+          std::cerr << "Map has Nside = " << map.Nside()
+                    << " but quad list has Nside = " << qlf.Nside()
+                    << "\nGiving up!\n";
+          std::exit(1);
+        }
+        qlf.build_index();
+        Npoint_Functions::Quadrilateral_Record_Sampler<double, int>
+          sampler (map, qlf);
+        Npoint_Functions::sample_npoint_function (sampler, sampler.size(),
+                                                  rng, tolerance, max_time,
+                                                  est[k]);
+        bin_list[k] = qlf.bin_value()*M_PI/180;
+      } else {
+        twopt_table.read_file (files[k]);
+        if (static_cast<size_t>(map.Npix()) < twopt_table.Npix()) {
+          std::cerr << "Map does not have enough pixels.\n";
+          std::exit(1);
+        }
+        if (mode == "twopt") {
+          Npoint_Functions::Twopt_Row_Sampler<double, int>
+            sampler (map, twopt_table);
+          Npoint_Functions::sample_npoint_function (sampler, sampler.size(),
+                                                    rng, tolerance,
+                                                    max_time, est[k]);
+        } else {
+          Npoint_Functions::Equilateral_Triangle_Sampler<double, int>
+            sampler (map, twopt_table);
+          Npoint_Functions::sample_npoint_function (sampler, sampler.size(),
+                                                    rng, tolerance,
+                                                    max_time, est[k]);
+        }
+        bin_list[k] = std::acos(twopt_table.bin_value());
+      }
+    }
+  }
+
+  // Same format as spice with the error and fraction sampled added.
+  for (size_t k=0; k < files.size(); ++k) {
+    std::cout << bin_list[k] << " " << std::cos(bin_list[k]) << " "
+              << est[k].value() << " " << est[k].error() << " "
+              << est[k].fraction() << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,184 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+
+#include <Twopt_Table.h>
+#include <Twopt_Table_Cache.h>
+#include <Pixel_Triangles.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_SCALENE_THREEPT_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <map fits file> "
+            << "<twopt tables prefix> <configuration file>\n"
+            << "         [<table cache size (MB)>]\n"
+            << " Each line of the configuration file contains the three side"
+            << " lengths (deg)\n"
+            << " of a triangle.  The closest bin to each side length will be"
+            << " used.  Comments\n"
+            << " start with #.  The configurations are reordered to reuse"
+            << " the two point tables\n"
+            << " which are kept in a cache of the given size (default 1024"
+            << " MB).\n"
+            << " The output is one line per configuration, in the order"
+            << " given, with the three\n"
+            << " side lengths (radians) of the bins used and the three point"
+            << " function.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if ((argc < 4) || (argc > 5)) usage (argv[0]);
+  std::string mapfile = argv[1];
+  std::string twopt_prefix = argv[2];
+  std::string configfile = argv[3];
+  double cache_MB = 1024;
+  if ((argc > 4) && (! Npoint_Functions::from_string (argv[4], cache_MB))) {
+    std::cerr << "Could not parse the cache size\n";
+    usage (argv[0]);
+  }
+
+  std::vector<std::string> twopt_table_file
+    = Npoint_Functions::get_sequential_file_list(twopt_prefix);
+  size_t Nbin = twopt_table_file.size();
+  if (Nbin == 0) {
+    std::cerr << "No files found with prefix " << twopt_prefix << std::endl;
+    std::exit(1);
+  }
+  // Only the headers are needed to pick the bins.
+  std::vector<double> bin_list(Nbin);
+  std::vector<size_t> Nmax(Nbin);
+  {
+    Npoint_Functions::Twopt_Table<int> tp;
+    for (size_t k=0; k < Nbin; ++k) {
+      if (! tp.read_file_header (twopt_table_file[k])) {
+        std::cerr << "Failed reading header of " << twopt_table_file[k]
+                  << std::endl;
+        std::exit(1);
+      }
+      bin_list[k] = tp.bin_value();
+      Nmax[k] = tp.Nmax();
+    }
+  }
+
+  // Read the configurations as the closest bins to the side lengths.
+  std::vector<std::vector<size_t> > config;
+  {
+    std::ifstream in (configfile.c_str());
+    if (! in.is_open()) {
+      std::cerr << "Failed reading " << configfile << std::endl;
+      std::exit(1);
+    }
+    std::string line;
+    std::string::iterator it;
+    std::vector<double> ang;
+    std::vector<size_t> bins(3);
+    while (in.good()) {
+      std::getline (in, line);
+      line = trim (line);
+      it = std::find (line.begin(), line.end(), '#');
+      if (it != line.end()) line.erase (it, line.end());
+      if (line == "") continue;
+      ang.clear();
+      split (line, ang);
+      if (ang.size() != 3) {
+        std::cerr << "Expected three side lengths per line in "
+                  << configfile << std::endl;
+        std::exit(1);
+      }
+      for (size_t s=0; s < 3; ++s) {
+        double cosang = std::cos(ang[s]*M_PI/180);
+        bins[s] = 0;
+        for (size_t k=1; k < Nbin; ++k) {
+          if (std::abs(cosang - bin_list[k])
+              < std::abs(cosang - bin_list[bins[s]]))
+            bins[s] = k;
+        }
+      }
+      config.push_back (bins);
+    }
+  }
+  size_t Nconfig = config.size();
+
+  /* The triangles do not depend on the order of the sides, so sort them.
+   * Sorting the configurations then puts those sharing tables next to
+   * each other and since they are handed out in order to the threads the
+   * tables tend to be used while they are in the cache. */
+  std::vector<std::pair<std::vector<size_t>, size_t> > order(Nconfig);
+  for (size_t c=0; c < Nconfig; ++c) {
+    order[c].first = config[c];
+    std::sort (order[c].first.begin(), order[c].first.end());
+    order[c].second = c;
+  }
+  std::sort (order.begin(), order.end());
+
+  Healpix_Map<double> map;
+  read_Healpix_map_from_fits (mapfile, map);
+  if (map.Scheme() == RING) map.swap_scheme();
+
+  Npoint_Functions::Twopt_Table_Cache<int>
+    cache (twopt_table_file, static_cast<size_t>(cache_MB*1024*1024), true);
+  std::vector<double> Corr(Nconfig);
+
+  /* With fewer configurations than threads they are done one at a time,
+   * each split over the threads. */
+  bool config_threads = Npoint_Functions::parallel_over_bins (Nconfig);
+
+#pragma omp parallel if(config_threads) shared(order, Corr, cache, map, Nmax)
+  {
+    Npoint_Functions::Twopt_Table_Cache<int>::table_ptr t[3];
+    std::vector<size_t> b(3);
+
+#pragma omp for schedule(dynamic,1)
+    for (size_t c=0; c < Nconfig; ++c) {
+      /* The first table is looped over and the rows of the others
+       * intersected so put the table with the fewest pairs first. */
+      b = order[c].first;
+      for (size_t s=1; s < 3; ++s) {
+        if (Nmax[b[s]] < Nmax[b[0]]) std::swap (b[0], b[s]);
+      }
+      for (size_t s=0; s < 3; ++s) t[s] = cache.get (b[s]);
+      // Cast to quiet the compiler about the signed/unsigned comparison.
+      if ((size_t)map.Npix() < t[0]->Npix()) {
+        std::cerr << "Map does not have enough pixels.\n";
+        std::exit(1);
+      }
+      // Sum the products as the triangles are found, none are stored.
+      Npoint_Functions::Threepoint_Kernel<double, int> kernel (map, *t[0]);
+      Npoint_Functions::visit_in_blocks
+        (Npoint_Functions::Scalene_Finder<int> (*t[0], *t[1], *t[2]),
+         *t[0], kernel);
+      Corr[order[c].second] = kernel.value();
+    }
+  }
+
+  size_t Nread = 0, Nused = 0;
+  for (size_t k=0; k < Nbin; ++k) {
+    Nread += cache.reads(k);
+    if (cache.reads(k) > 0) ++Nused;
+  }
+  std::cerr << "Read " << Nused << " two point tables " << Nread
+            << " times for " << Nconfig << " configurations.\n";
+
+  for (size_t c=0; c < Nconfig; ++c) {
+    std::cout << std::acos(bin_list[config[c][0]]) << " "
+              << std::acos(bin_list[config[c][1]]) << " "
+              << std::acos(bin_list[config[c][2]]) << " "
+              << Corr[c] << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <string>
+#include <cmath>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+
+#include <Triangle_List_File.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_THREEPT_FROM_TRIANGLE_LIST_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <triangle list prefix> "
+            << "<map fits file> [<map fits file> ...]\n"
+            << " The three point function is calculated from triangle list"
+            << " files, see\n"
+            << " create_equilateral_triangle_list, for all the maps at"
+            << " once.  Each line of\n"
+            << " the output has the three side lengths (radians) followed by"
+            << " the three point\n"
+            << " function of each map.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if (argc < 3) usage (argv[0]);
+  std::string triangle_prefix = argv[1];
+  size_t Nmaps = argc - 2;
+
+  std::vector<std::string> triangle_list_files
+    = Npoint_Functions::get_sequential_file_list (triangle_prefix);
+  if (triangle_list_files.size() == 0) {
+    std::cerr << "No triangle list files found!\n";
+    usage (argv[0]);
+  }
+
+  std::vector<Healpix_Map<double> > maps (Nmaps);
+  {
+    Npoint_Functions::Triangle_List_File<int> tlf;
+    if (! tlf.initialize (triangle_list_files[0])) std::exit(1);
+    for (size_t j=0; j < Nmaps; ++j) {
+      read_Healpix_map_from_fits (argv[j+2], maps[j]);
+      if (static_cast<size_t>(maps[j].Nside()) != tlf.Nside()) {
+        std::cerr << "Map " << argv[j+2] << " has Nside = "
+                  << maps[j].Nside() << " but the triangle lists have"
+                  << " Nside = " << tlf.Nside() << std::endl;
+        std::exit(1);
+      }
+      if (maps[j].Scheme() != tlf.Scheme()) maps[j].swap_scheme();
+    }
+  }
+  // Fetch the values for all maps at a pixel together.
+  std::vector<double> fields;
+  Npoint_Functions::make_pixel_major (maps, fields);
+  std::vector<Healpix_Map<double> >().swap (maps);
+
+  std::vector<std::vector<double> > bin_list(triangle_list_files.size(),
+                                             std::vector<double>(3));
+  std::vector<std::vector<double> > Corr(triangle_list_files.size());
+
+#pragma omp parallel shared(triangle_list_files, bin_list, Corr, fields)
+  {
+    Npoint_Functions::Triangle_List_File<int> tlf;
+
+#pragma omp for schedule(dynamic,1)
+    for (size_t k=0; k < triangle_list_files.size(); ++k) {
+      if (! tlf.initialize (triangle_list_files[k])) {
+        std::cerr << "Error initializing triangle list from "
+                  << triangle_list_files[k] << std::endl;
+        std::exit(1);
+      }
+      for (size_t s=0; s < 3; ++s) bin_list[k][s] = tlf.bin_value(s);
+      Npoint_Functions::calculate_threepoint_function_list (fields, Nmaps,
+                                                            tlf, Corr[k]);
+    }
+  }
+
+  for (size_t k=0; k < Corr.size(); ++k) {
+    for (size_t s=0; s < 3; ++s) std::cout << std::acos(bin_list[k][s]) << " ";
+    for (size_t j=0; j < Nmaps; ++j) std::cout << Corr[k][j] << " ";
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
@@ -18,20 +18,32 @@ namespace {
 void usage (const char *progname)
 {
   std::cerr << "Usage: " << progname << " <map fits file> "
-            << "<twopt tables prefix>\n";
+            << "<twopt tables prefix> [<mask or weight fits file>]\n";
   exit (1);
 }
 
 
 int main (int argc, char *argv[])
 {
-  if (argc != 3) usage (argv[0]);
+  if ((argc < 3) || (argc > 4)) usage (argv[0]);
   std::string mapfile = argv[1];
   std::string twopt_prefix = argv[2];
   
   Healpix_Map<double> map;
   read_Healpix_map_from_fits (mapfile, map);
   if (map.Scheme() == RING) map.swap_scheme();
+  bool have_weight = false;
+  Healpix_Map<double> weight;
+  if (argc == 4) {
+    read_Healpix_map_from_fits (argv[3], weight);
+    if (weight.Scheme() == RING) weight.swap_scheme();
+    if (weight.Nside() != map.Nside()) {
+      std::cerr << "Map and weights do not have the same Nside: "
+                << map.Nside() << " != " << weight.Nside() << std::endl;
+      std::exit(1);
+    }
+    have_weight = true;
+  }
 
   // Figure out how many bins there are by trying to open files.
   std::vector<std::string> twopt_table_file
@@ -40,34 +52,20 @@ int main (int argc, char *argv[])
   std::vector<double> bin_list(twopt_table_file.size());
   std::vector<double> Corr(twopt_table_file.size());
 
-#pragma omp parallel shared(Corr, bin_list, twopt_table_file)
+#pragma omp parallel shared(Corr, bin_list, twopt_table_file, map, weight)
   {
-    size_t Npair;
-    double C2, Csum;
-    int p1, p2;
     Npoint_Functions::Twopt_Table<int> twopt_table;
 #pragma omp for schedule(guided)
     for (size_t k=0; k < twopt_table_file.size(); ++k) {
       twopt_table.read_file (twopt_table_file[k]);
-      C2 = 0;
-      Npair = 0;
-      for (size_t i=0; i < twopt_table.Npix(); ++i) {
-        Csum = 0;
-        p1 = twopt_table.pixel_list()[i];
-        for (size_t j=0;
-             ((j < twopt_table.Nmax())
-              && (twopt_table(i,j) != -1));
-             ++j) {
-          p2 = twopt_table.pixel_list()[twopt_table(i,j)];
-          if (p1 > p2) continue; // Avoid double counting.
-          ++Npair;
-          Csum += map[p2];
-        }
-        C2 += map[p1] * Csum;
+      if (have_weight) {
+        Corr[k] = Npoint_Functions::calculate_weighted_twopt_function
+          (map, weight, twopt_table);
+      } else {
+        Corr[k] = Npoint_Functions::calculate_twopt_function
+          (map, twopt_table);
       }
-      C2 /= Npair;
       bin_list[k] = twopt_table.bin_value();
-      Corr[k] = C2;
     }
   }
 
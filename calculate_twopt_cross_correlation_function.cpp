@@ -0,0 +1,98 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cmath>
+
+#include <healpix_map.h>
+#include <healpix_map_fitsio.h>
+
+#include <Twopt_Table.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CALCULATE_TWOPT_CROSS_CORRELATION_FUNCTION_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <twopt tables prefix> "
+            << "<map fits file 1> <map fits file 2> [<map fits file 3> ...]\n"
+            << " All auto and cross correlation functions of the maps are"
+            << " calculated.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if (argc < 4) usage (argv[0]);
+  std::string twopt_prefix = argv[1];
+  size_t K = argc - 2;
+
+  std::vector<Healpix_Map<double> > maps (K);
+  for (size_t a=0; a < K; ++a) {
+    read_Healpix_map_from_fits (argv[a+2], maps[a]);
+    if (maps[a].Scheme() == RING) maps[a].swap_scheme();
+    if (maps[a].Nside() != maps[0].Nside()) {
+      std::cerr << "All maps must have the same Nside: "
+                << argv[a+2] << std::endl;
+      std::exit(1);
+    }
+  }
+  int Nside = maps[0].Nside();
+  std::vector<double> fields;
+  Npoint_Functions::make_pixel_major (maps, fields);
+  maps.clear();
+
+  // Figure out how many bins there are by trying to open files.
+  std::vector<std::string> twopt_table_file
+    = Npoint_Functions::get_sequential_file_list (twopt_prefix);
+  if (twopt_table_file.size() == 0) {
+    std::cerr << "No two point table files found!\n";
+    usage (argv[0]);
+  }
+  {
+    Npoint_Functions::Twopt_Table<int> tp;
+    tp.read_file_header (twopt_table_file[0]);
+    if (static_cast<size_t>(Nside) != tp.Nside()) {
+      std::cerr << "Maps and two point tables do not have the same Nside: "
+                << Nside << " != " << tp.Nside() << std::endl;
+      std::exit(1);
+    }
+  }
+
+  std::vector<double> bin_list(twopt_table_file.size());
+  std::vector<std::vector<double> > Corr(twopt_table_file.size());
+
+#pragma omp parallel shared(Corr, bin_list, twopt_table_file, fields)
+  {
+    Npoint_Functions::Twopt_Table<int> twopt_table;
+#pragma omp for schedule(guided)
+    for (size_t k=0; k < twopt_table_file.size(); ++k) {
+      twopt_table.read_file (twopt_table_file[k]);
+      Npoint_Functions::calculate_twopt_cross_function (fields, K,
+                                                        twopt_table,
+                                                        Corr[k]);
+      bin_list[k] = twopt_table.bin_value();
+    }
+  }
+
+  std::cout << "# Two point cross correlation functions from "
+            << twopt_prefix << std::endl;
+  std::cout << "# Columns are theta, cos(theta), then C_ab for a <= b:";
+  for (size_t a=0; a < K; ++a) {
+    for (size_t b=a; b < K; ++b) std::cout << " " << a << "," << b;
+  }
+  std::cout << std::endl;
+  for (size_t k=0; k < twopt_table_file.size(); ++k) {
+    std::cout << std::acos(bin_list[k]) << " " << bin_list[k];
+    for (size_t a=0; a < K; ++a) {
+      for (size_t b=a; b < K; ++b) std::cout << " " << Corr[k][a*K+b];
+    }
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <string>
+
+#include <Twopt_Table.h>
+#include <Pixel_Triangles.h>
+#include <Triangle_List_File.h>
+#include <Npoint_Functions_Utils.h>
+
+namespace {
+  const std::string CREATE_EQUILATERAL_TRIANGLE_LIST_RCSID
+  ("$Id$");
+}
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <twopt tables prefix> "
+            << "<triangle list prefix>\n"
+            << " The equilateral triangles for each two point table are"
+            << " written to a\n"
+            << " triangle list file numbered the same as the table.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if (argc != 3) usage (argv[0]);
+  std::string twopt_prefix = argv[1];
+  std::string triangle_prefix = argv[2];
+
+  std::vector<std::string> twopt_table_list
+    = Npoint_Functions::get_sequential_file_list (twopt_prefix);
+  if (twopt_table_list.size() == 0) {
+    std::cerr << "No files found with prefix " << twopt_prefix << std::endl;
+    std::exit(1);
+  }
+
+#pragma omp parallel shared(twopt_table_list)
+  {
+    Npoint_Functions::Twopt_Table<int> twopt_table;
+    Npoint_Functions::Triangle_List_File<int> tlf;
+
+#pragma omp for schedule(guided)
+    for (size_t k=0; k < twopt_table_list.size(); ++k) {
+      if (! twopt_table.read_file (twopt_table_list[k], true)) {
+        std::cerr << "Failed reading two point table "
+                  << twopt_table_list[k] << std::endl;
+        std::exit(1);
+      }
+      double bv[3];
+      bv[0] = bv[1] = bv[2] = twopt_table.bin_value();
+      std::string outfile
+        = Npoint_Functions::make_filename (triangle_prefix, k);
+      if (! tlf.create (outfile, twopt_table.Nside(), twopt_table.Scheme(),
+                        bv)) {
+        std::exit(1);
+      }
+      Npoint_Functions::Triangle_List_Writer<int> writer (tlf, twopt_table);
+      Npoint_Functions::visit_equilateral_triangles (twopt_table, writer);
+      writer.finish();
+      tlf.close();
+    }
+  }
+
+  return 0;
+}
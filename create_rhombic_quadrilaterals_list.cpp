@@ -24,7 +24,7 @@ int main (int argc, char *argv[])
   std::string twopt_table_file = argv[1];
 
   Npoint_Functions::Twopt_Table<int> twopt_table;
-  twopt_table.read_file (twopt_table_file);                                        
+  twopt_table.read_file (twopt_table_file, true);                                        
   Npoint_Functions::Pixel_Triangles_Equilateral<int> triangles;
   std::vector<int> tri;
   std::vector<int> thirdpt;
@@ -0,0 +1,328 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstdio>
+#include <tr1/memory> // For std::tr1::shared_ptr
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+#include <Twopt_Table.h>
+#include <Pixel_Triangles.h>
+#include <Pixel_Quadrilaterals.h>
+#include <Quadrilateral_List_File.h>
+#include <Npoint_Functions_Utils.h>
+
+/* Native replacement for create_rhombic_quadrilaterals_list_parallel piped
+ * through perl, sort, and create_compressed_quadrilateral_table.py.  The
+ * quadrilaterals are found as in the parallel code, stored with their
+ * pixels in increasing order, sorted and made unique in memory by each
+ * thread, spilled to disk when the memory limit is reached, and finally
+ * merged and written directly as a Quadrilateral_List_File. */
+
+namespace {
+  const std::string CREATE_RHOMBIC_QUADRILATERALS_LIST_FILE_RCSID
+  ("$Id$");
+}
+
+/// @cond NODOC
+// A quadrilateral with its pixels in increasing order.
+struct Quad {
+  int p[4];
+
+  inline void set (const std::vector<int>& tri, int thirdpt)
+  {
+    p[0] = tri[0]; p[1] = tri[1]; p[2] = tri[2]; p[3] = thirdpt;
+    // Sorting network for four values.
+    if (p[0] > p[1]) std::swap (p[0], p[1]);
+    if (p[2] > p[3]) std::swap (p[2], p[3]);
+    if (p[0] > p[2]) std::swap (p[0], p[2]);
+    if (p[1] > p[3]) std::swap (p[1], p[3]);
+    if (p[1] > p[2]) std::swap (p[1], p[2]);
+  }
+  inline bool operator< (const Quad& q) const
+  {
+    if (p[0] != q.p[0]) return p[0] < q.p[0];
+    if (p[1] != q.p[1]) return p[1] < q.p[1];
+    if (p[2] != q.p[2]) return p[2] < q.p[2];
+    return p[3] < q.p[3];
+  }
+  inline bool operator== (const Quad& q) const
+  {
+    return ((p[0] == q.p[0]) && (p[1] == q.p[1])
+            && (p[2] == q.p[2]) && (p[3] == q.p[3]));
+  }
+  inline bool operator!= (const Quad& q) const { return ! (*this == q); }
+};
+
+/* Sorted, unique runs of quadrilaterals.  Runs are either kept in memory
+ * or spilled to a temporary file. */
+class Quad_Runs {
+private :
+  std::string file_prefix;
+  std::vector<std::string> files;
+  std::vector<std::vector<Quad> > memory;
+public :
+  Quad_Runs (const std::string& prefix)
+    : file_prefix(prefix), files(), memory() {}
+
+  ~Quad_Runs ()
+  {
+    for (size_t k=0; k < files.size(); ++k) std::remove (files[k].c_str());
+  }
+
+  // Write the run to a temporary file.
+  void spill (const std::vector<Quad>& run)
+  {
+    std::string filename;
+#pragma omp critical(quad_runs)
+    {
+      std::ostringstream sstr;
+      sstr << file_prefix << ".run" << files.size();
+      filename = sstr.str();
+      files.push_back (filename);
+    }
+    std::ofstream out (filename.c_str(), std::fstream::out
+                       | std::fstream::trunc | std::fstream::binary);
+    out.write (reinterpret_cast<const char*>(&run[0]),
+               run.size()*sizeof(Quad));
+    out.close();
+    if (out.fail()) {
+      std::cerr << "Failed writing temporary file " << filename << std::endl;
+      std::exit(1);
+    }
+  }
+
+  // Keep the run in memory, run is emptied.
+  void keep (std::vector<Quad>& run)
+  {
+#pragma omp critical(quad_runs)
+    {
+      memory.push_back (std::vector<Quad>());
+      memory.back().swap (run);
+    }
+  }
+
+  inline size_t Nfile () const { return files.size(); }
+  inline const std::string& file (size_t k) const { return files[k]; }
+  inline size_t Nmemory () const { return memory.size(); }
+  inline std::vector<Quad>& memory_run (size_t k) { return memory[k]; }
+};
+
+/* Collect the quadrilaterals found by one thread.  This is the functor
+ * passed to Npoint_Functions::Rhombic_Symmetry_Images. */
+class Quad_Collector {
+private :
+  std::vector<Quad> quads;
+  size_t Nsorted, Nmax;
+  Quad_Runs& runs;
+
+  // Sort and remove repeats.  The first Nsorted are already sorted.
+  void compact ()
+  {
+    std::sort (quads.begin()+Nsorted, quads.end());
+    std::inplace_merge (quads.begin(), quads.begin()+Nsorted, quads.end());
+    quads.erase (std::unique (quads.begin(), quads.end()), quads.end());
+    Nsorted = quads.size();
+  }
+public :
+  Quad_Collector (size_t N, Quad_Runs& r)
+    : quads(), Nsorted(0), Nmax(std::max (N, static_cast<size_t>(1))),
+      runs(r)
+  { quads.reserve (Nmax); }
+
+  void operator() (const std::vector<int>& tri,
+                   const std::vector<int>& thirdpt)
+  {
+    Quad q;
+    for (size_t j=0; j < thirdpt.size(); ++j) {
+      q.set (tri, thirdpt[j]);
+      quads.push_back (q);
+      if (quads.size() >= Nmax) {
+        compact();
+        /* Only spill when removing the repeats did not free up a good
+         * fraction of the buffer. */
+        if (2*quads.size() > Nmax) {
+          runs.spill (quads);
+          quads.clear();
+          Nsorted = 0;
+        }
+      }
+    }
+  }
+
+  // Hand the remaining quadrilaterals off to the runs.
+  void finish ()
+  {
+    compact();
+    if (quads.size() > 0) runs.keep (quads);
+    quads.clear();
+    Nsorted = 0;
+  }
+};
+
+// Sequential access to a sorted run for the merge.
+class Quad_Run_Reader {
+private :
+  std::vector<Quad> buf;
+  size_t pos;
+  std::tr1::shared_ptr<std::ifstream> fd;
+
+  bool refill ()
+  {
+    pos = 0;
+    buf.clear();
+    if (! fd) return false;
+    const size_t Nbuf = 65536;
+    buf.resize (Nbuf);
+    fd->read (reinterpret_cast<char*>(&buf[0]), Nbuf*sizeof(Quad));
+    buf.resize (fd->gcount() / sizeof(Quad));
+    return (buf.size() > 0);
+  }
+public :
+  // Run held in memory, run is emptied.
+  Quad_Run_Reader (std::vector<Quad>& run) : buf(), pos(0), fd()
+  { buf.swap (run); }
+  // Run spilled to a file.
+  Quad_Run_Reader (const std::string& filename)
+    : buf(), pos(0),
+      fd(new std::ifstream (filename.c_str(), std::fstream::in
+                            | std::fstream::binary))
+  {
+    if (! *fd) {
+      std::cerr << "Failed reading temporary file " << filename << std::endl;
+      std::exit(1);
+    }
+    refill();
+  }
+
+  inline bool done () const { return (pos >= buf.size()); }
+  inline const Quad& current () const { return buf[pos]; }
+  inline bool advance ()
+  {
+    ++pos;
+    if (pos < buf.size()) return true;
+    return refill();
+  }
+};
+/// @endcond
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " <two point table name> "
+            << "<output quad file> [memory MB]\n"
+            << " The unique rhombic quadrilaterals are written in the"
+            << " compressed format read\n"
+            << " by Quadrilateral_List_File.  At most [memory MB],"
+            << " default 2048, is used to\n"
+            << " store the quadrilaterals before they are spilled to"
+            << " temporary files next to\n"
+            << " the output file.\n";
+  exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+  if ((argc != 3) && (argc != 4)) usage (argv[0]);
+
+  std::string twopt_table_file = argv[1];
+  std::string output_file = argv[2];
+  size_t max_bytes = 2048;
+  if (argc == 4) {
+    if (! Npoint_Functions::from_string (argv[3], max_bytes)) {
+      std::cerr << "Memory must be a number of megabytes, not "
+                << argv[3] << std::endl;
+      usage (argv[0]);
+    }
+  }
+  max_bytes *= 1024*1024;
+
+  Npoint_Functions::Pixel_Quadrilaterals_Rhombic<int> q;
+  Npoint_Functions::Twopt_Table<int> twopt_table;
+  if (! twopt_table.read_file (twopt_table_file, true)) {
+    std::cerr << "Failed reading two point table "
+              << twopt_table_file << std::endl;
+    std::exit(1);
+  }
+  Npoint_Functions::Pixel_Triangles_Equilateral<int> triangles;
+  triangles.find_triangles (twopt_table);
+  q.initialize (triangles);
+
+  std::vector<Npoint_Functions::PixelInfo> pixel_list;
+  Npoint_Functions::rhombic_pixel_list (q.Nside(), pixel_list);
+  std::vector<char> pixel_base;
+  Npoint_Functions::rhombic_pixel_base (q.Nside(), pixel_list, pixel_base);
+  // Build the symmetry tables in parallel before the threads share them.
+  Npoint_Functions::Pixel_Symmetry_Tables::get (q.Nside(), q.Scheme());
+
+  Quad_Runs runs (output_file);
+
+#pragma omp parallel shared (pixel_list, pixel_base, runs) firstprivate (q)
+  {
+    std::vector<int> tri;
+    std::vector<int> thirdpt;
+    thirdpt.reserve(1000);
+    int Nthreads = 1;
+#ifdef OMP
+    Nthreads = omp_get_num_threads();
+#endif
+
+    Npoint_Functions::Rhombic_Symmetry_Images<int> images (q, pixel_base);
+    Quad_Collector collector (max_bytes / (Nthreads*sizeof(Quad)), runs);
+
+#pragma omp for schedule(dynamic,1)
+    for (size_t j=0; j < pixel_list.size(); ++j) {
+      q.initialize (pixel_list[j].pixnum);
+      while (q.next(tri, thirdpt)) {
+        images (pixel_list[j].basepix, tri, thirdpt, collector);
+      }
+    }
+    collector.finish();
+  }
+
+  // Merge the runs, removing repeats, directly into the output.
+  typedef std::tr1::shared_ptr<Quad_Run_Reader> reader_ptr;
+  std::vector<reader_ptr> readers;
+  for (size_t k=0; k < runs.Nmemory(); ++k)
+    readers.push_back (reader_ptr (new Quad_Run_Reader
+                                   (runs.memory_run(k))));
+  for (size_t k=0; k < runs.Nfile(); ++k)
+    readers.push_back (reader_ptr (new Quad_Run_Reader (runs.file(k))));
+
+  typedef std::pair<Quad, size_t> entry;
+  std::priority_queue<entry, std::vector<entry>, std::greater<entry> > heap;
+  for (size_t k=0; k < readers.size(); ++k) {
+    if (! readers[k]->done()) heap.push (entry (readers[k]->current(), k));
+  }
+
+  Npoint_Functions::Quadrilateral_List_File<int> qlf;
+  if (! qlf.create (output_file, twopt_table.Nside(), twopt_table.Scheme(),
+                    std::acos(twopt_table.bin_value())*180/M_PI)) {
+    std::exit(1);
+  }
+  Quad prev;
+  bool have_prev = false;
+  while (! heap.empty()) {
+    entry e = heap.top();
+    heap.pop();
+    if ((! have_prev) || (e.first != prev)) {
+      qlf.add_quadrilateral (e.first.p);
+      prev = e.first;
+      have_prev = true;
+    }
+    if (readers[e.second]->advance())
+      heap.push (entry (readers[e.second]->current(), e.second));
+  }
+  qlf.close();
+
+  return 0;
+}
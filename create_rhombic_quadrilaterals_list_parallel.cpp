@@ -1,10 +1,22 @@
 #include <iostream>
-#include <iomanip>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sched.h>
+#include <time.h> // For nanosleep
+
+#ifdef OMP
+#include <omp.h>
+#endif
 
 #include <Twopt_Table.h>
 #include <Pixel_Triangles.h>
 #include <Pixel_Quadrilaterals.h>
+#include <Npoint_Functions_Utils.h>
 
 #include <healpix_base.h>
 
@@ -20,234 +32,335 @@ namespace {
 }
 
 /// @cond NODOC
-/* Simple vector.  NOT for general use.
- * This is a thin wrapper around raw memory without error checking ....
- */
-template<typename T>
-class simple_vector {
-private :
-  size_t Nbuf, N;
-  T *buf;
-public :
-  simple_vector () : Nbuf(0), N(0), buf(0) {}
-  simple_vector (size_t size) : Nbuf(size), N(0), buf(new T[size]) {}
-  ~simple_vector () { if (buf != 0) delete [] buf; }
-  
-  inline T& operator [] (size_t j) { return buf[j]; }
-  inline const T operator [] (size_t j) const { return buf[j]; }
- // NO ERROR CHECKING IS PERFORMED!
-  inline void push_back (const T& val)
-  { buf[N++] = val; }
-  inline size_t size() const { return N; }
-  inline size_t capacity() const { return Nbuf; }
-  inline void clear() { N = 0; }
-};
-
-// Simple wrapper
-struct PixelInfo {
-  enum BasePix { BASE0, BASE4} basepix;
-  int pixnum;
-};
-  
-// Simple class to handle transforming pixels.
-class PixelTrans {
+/* Bounded ring queue of block numbers.  Each push and pop takes a ticket
+ * with an atomic increment and then waits for its slot, so any number of
+ * threads may push and pop without locks.  Pop waits until something is
+ * available.  Waiting threads spin briefly and then sleep for increasing
+ * intervals so an idle writer or worker does not tie up a core. */
+class Block_Queue {
 private :
-  myHealpix::pixel_ringinfo pri;
-  Healpix_Base HBase;
+  size_t N;
+  std::vector<long> seq;
+  std::vector<int> val;
+  long head, tail;
 
-  // Wrappers to handle the scheme for our pixels.
-  inline void pri_setpix (int p)
+  // Wait until the slot k has sequence number s.
+  void wait_for (size_t k, long s)
   {
-    if (HBase.Scheme() == NEST) {
-      pri.from_pixel (HBase.nest2ring(p));
-    } else {
-      pri.from_pixel (p);
+    const int Nspin = 64;
+    const long max_sleep = 1000000; // 1ms in ns.
+    long c;
+    int spin = 0;
+    struct timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = 1000;
+    while (true) {
+#pragma omp flush
+#pragma omp atomic read
+      c = seq[k];
+      if (c == s) break;
+      if (spin < Nspin) {
+        ++spin;
+        sched_yield();
+      } else {
+        nanosleep (&ts, 0);
+        if (ts.tv_nsec < max_sleep) ts.tv_nsec *= 2;
+      }
     }
+#pragma omp flush
   }
-/// @endcond
 
-  inline int pri_frompix ()
+  void publish (size_t k, long s)
   {
-    if (HBase.Scheme() == NEST) {
-      return HBase.ring2nest(pri.to_pixel());
-    } else {
-      return pri.to_pixel();
-    }
+#pragma omp flush
+#pragma omp atomic write
+    seq[k] = s;
+#pragma omp flush
+  }
+public :
+  Block_Queue (size_t size)
+    : N(size), seq(size), val(size, 0), head(0), tail(0)
+  {
+    for (size_t k=0; k < N; ++k) seq[k] = k;
+  }
+
+  void push (int v)
+  {
+    long pos;
+#pragma omp atomic capture
+    pos = tail++;
+    size_t k = pos % N;
+    wait_for (k, pos);
+    val[k] = v;
+    publish (k, pos+1);
   }
 
-  inline int shift_pix_by_base (int p)
+  int pop ()
   {
-    pri_setpix (p);
-    pri.shift_by_base_pixel();
-    return pri_frompix();
-  }      
+    long pos;
+#pragma omp atomic capture
+    pos = head++;
+    size_t k = pos % N;
+    wait_for (k, pos+1);
+    int v = val[k];
+    publish (k, pos+N);
+    return v;
+  }
+};
+
+/* Output of the quadrilaterals.  The workers fill fixed size blocks of
+ * quadrilaterals and pass them to a single writer thread which writes
+ * them with large sequential writes, either as text, one quadrilateral
+ * per line, or as native ints.  The blocks are recycled so the memory
+ * used is fixed.  Without a writer thread the blocks are written
+ * directly.
+ */
+class Quad_Output {
+private :
+  static const size_t Nquad_block = 16384;
+  static const size_t Nout = 4*1024*1024;
+  bool binary;
+  int Nworkers;
+  size_t Nblocks;
+  std::vector<int> pool;
+  std::vector<size_t> count;
+  Block_Queue free_blocks, full_blocks;
+  std::vector<char> out;
+  size_t Nout_used;
 
-  inline int reflect_pix_through_zaxis (int p)
+  void flush_output ()
   {
-    pri_setpix (p);
-    pri.reflect_through_zaxis();
-    return pri_frompix();
+    if (Nout_used == 0) return;
+    if (std::fwrite (&out[0], 1, Nout_used, stdout) != Nout_used) {
+      std::cerr << "Failed writing quadrilaterals\n";
+      std::exit (1);
+    }
+    Nout_used = 0;
   }
 
-  inline int reflect_pix_through_z0 (int p)
+  inline void append_int (int v)
   {
-    pri_setpix (p);
-    pri.reflect_through_z0();
-    return pri_frompix();
+    char digits[16];
+    int n = 0;
+    unsigned int u = ((v < 0) ? -static_cast<unsigned int>(v) : v);
+    do {
+      digits[n++] = '0' + (u % 10);
+      u /= 10;
+    } while (u > 0);
+    if (v < 0) out[Nout_used++] = '-';
+    while (n > 0) out[Nout_used++] = digits[--n];
   }
 
+  void write_block (int b)
+  {
+    const int *quad = block (b);
+    if (binary) {
+      size_t Nbytes = 4*count[b]*sizeof(int);
+      if (Nout_used + Nbytes > Nout) flush_output();
+      std::memcpy (&out[Nout_used], quad, Nbytes);
+      Nout_used += Nbytes;
+      return;
+    }
+    for (size_t j=0; j < count[b]; ++j, quad+=4) {
+      // At most 4 ints of 11 characters each with separators.
+      if (Nout_used + 64 > Nout) flush_output();
+      for (int k=0; k < 4; ++k) {
+        append_int (quad[k]);
+        out[Nout_used++] = ' ';
+      }
+      out[Nout_used++] = '\n';
+    }
+  }
 public :
-  PixelTrans (size_t Nside, Healpix_Ordering_Scheme scheme)
-    : pri(Nside), HBase (Nside, scheme, SET_NSIDE) {}
+  /// The output uses at most about \a Nbytes for the blocks.
+  Quad_Output (size_t Nbytes, bool binary_output)
+    : binary(binary_output), Nworkers(0),
+      Nblocks(std::max (Nbytes / (4*Nquad_block*sizeof(int)),
+                        static_cast<size_t>(2))),
+      pool(4*Nquad_block*Nblocks), count(Nblocks, 0),
+      free_blocks(Nblocks), full_blocks(Nblocks),
+      out(Nout), Nout_used(0)
+  {
+    for (size_t b=0; b < Nblocks; ++b) free_blocks.push (b);
+    // The output is already written in large pieces.
+    std::setvbuf (stdout, 0, _IONBF, 0);
+  }
 
-  inline void shift_by_base (std::vector<int>& pl)
-  { for (size_t j=0; j < pl.size(); ++j) pl[j] = shift_pix_by_base (pl[j]); }
+  ~Quad_Output () { flush_output(); }
 
-  inline void reflect_through_zaxis (std::vector<int>& pl)
-  { for (size_t j=0; j < pl.size(); ++j) pl[j] = reflect_pix_through_zaxis (pl[j]); }
+  /** Blocks are passed to a writer thread from \a workers threads, or
+   *  written directly if it is 0.  Must be set before any blocks are
+   *  passed on. */
+  inline void set_workers (int workers) { Nworkers = workers; }
 
-  inline void reflect_through_z0 (std::vector<int>& pl)
-  { for (size_t j=0; j < pl.size(); ++j) pl[j] = reflect_pix_through_z0 (pl[j]); }
-};
+  inline int* block (int b) { return &pool[4*Nquad_block*b]; }
+  inline size_t block_size () const { return Nquad_block; }
 
+  /// An empty block to fill, waiting for one if needed.
+  inline int get_block () { return free_blocks.pop(); }
 
-void usage (const char *progname)
-{
-  std::cerr << "Usage: " << progname << " <two point table name>\n";
-  exit (0);
-}
+  /// Pass on block \a b holding \a N quadrilaterals.
+  void put_block (int b, size_t N)
+  {
+    count[b] = N;
+    if (Nworkers == 0) {
+      write_block (b);
+      free_blocks.push (b);
+    } else {
+      full_blocks.push (b);
+    }
+  }
 
-void write_quad_buffer (const simple_vector<int>& quad_buf)
-{
-#pragma omp critical
+  /// A worker has no more blocks.
+  void worker_done ()
   {
-    for (size_t j=0; j < quad_buf.size(); j+=4) {
-      for (int k=0; k < 4; ++k) {
-        std::cout << quad_buf[j+k] << " ";
+    if (Nworkers > 0) full_blocks.push (-1);
+  }
+
+  /// Write blocks until all the workers are done.
+  void run_writer ()
+  {
+    int Ndone = 0;
+    while (Ndone < Nworkers) {
+      int b = full_blocks.pop();
+      if (b < 0) {
+        ++Ndone;
+      } else {
+        write_block (b);
+        free_blocks.push (b);
       }
-      std::cout << std::endl;
     }
+    flush_output();
   }
-}
+};
 
-void add_quads (const std::vector<int>& tri,
-                const std::vector<int>& thirdpt,
-                simple_vector<int>& quad_buf)
-{
-  for (size_t j=0; j < thirdpt.size(); ++j) {
-    for (size_t i=0; i < tri.size(); ++i) quad_buf.push_back(tri[i]);
-    quad_buf.push_back(thirdpt[j]);
-    /* We really don't want the buffer to "overflow" since
-     * it could end up needed a huge amount of memory.  Instead we
-     * will just empty it if the need arises. */
-    if (quad_buf.size() >= 4*quad_buf.capacity()) {
-      write_quad_buffer (quad_buf);
-      quad_buf.clear();
+// Functor for Npoint_Functions::Rhombic_Symmetry_Images
+class Quad_Adder {
+private :
+  Quad_Output& output;
+  int b;
+  int *quad;
+  size_t N;
+public :
+  Quad_Adder (Quad_Output& qo) : output(qo), b(-1), quad(0), N(0) {}
+
+  inline void operator() (const std::vector<int>& tri,
+                          const std::vector<int>& thirdpt)
+  {
+    for (size_t j=0; j < thirdpt.size(); ++j) {
+      // Blocks are only taken when needed so idle threads hold none.
+      if (b < 0) {
+        b = output.get_block();
+        quad = output.block (b);
+        N = 0;
+      }
+      int *p = quad + 4*N;
+      p[0] = tri[0]; p[1] = tri[1]; p[2] = tri[2]; p[3] = thirdpt[j];
+      if (++N == output.block_size()) {
+        output.put_block (b, N);
+        b = -1;
+      }
     }
   }
+
+  void finish ()
+  {
+    if (b >= 0) output.put_block (b, N);
+    b = -1;
+    output.worker_done();
+  }
+};
+/// @endcond
+
+
+void usage (const char *progname)
+{
+  std::cerr << "Usage: " << progname << " [-b] <two point table name>"
+            << " [buffer MB]\n"
+            << " The rhombic quadrilaterals are written to standard"
+            << " output, one per line, or\n"
+            << " as native ints with -b.  At most [buffer MB], default 64,"
+            << " is used to buffer\n"
+            << " them.\n";
+  exit (0);
 }
 
 
 int main (int argc, char *argv[])
 {
-  if (argc != 2) usage (argv[0]);
+  bool binary = ((argc > 1) && (std::string(argv[1]) == "-b"));
+  int arg = (binary ? 2 : 1);
+  if ((argc != arg+1) && (argc != arg+2)) usage (argv[0]);
 
-  std::string twopt_table_file = argv[1];
+  std::string twopt_table_file = argv[arg];
+  size_t buffer_bytes = 64;
+  if ((argc == arg+2)
+      && (! Npoint_Functions::from_string (argv[arg+1], buffer_bytes))) {
+    std::cerr << "Buffer size must be a number of megabytes, not "
+              << argv[arg+1] << std::endl;
+    usage (argv[0]);
+  }
+  buffer_bytes *= 1024*1024;
 
   Npoint_Functions::Pixel_Quadrilaterals_Rhombic<int> q;
   Npoint_Functions::Twopt_Table<int> twopt_table;
-  twopt_table.read_file (twopt_table_file);
+  twopt_table.read_file (twopt_table_file, true);
   Npoint_Functions::Pixel_Triangles_Equilateral<int> triangles;
   triangles.find_triangles (twopt_table);
   q.initialize (triangles);
 
   /* Build the list of pixels storing information about their base pixel as
    * this is needed for the transformations. */
-  std::vector<PixelInfo> pixel_list;
-  {
-    std::vector<int> pl0, pl4;
-    myHealpix::base0_list (q.Nside(), pl0);
-    myHealpix::base4_list (q.Nside(), pl4);
-    pixel_list.resize(pl0.size()+pl4.size());
-    for (size_t j=0; j < pl0.size(); ++j) {
-      pixel_list[j].pixnum = pl0[j];
-      pixel_list[j].basepix = PixelInfo::BASE0;
-    }      
-    for (size_t j=0; j < pl4.size(); ++j) {
-      pixel_list[j+pl0.size()].pixnum = pl4[j];
-      pixel_list[j+pl0.size()].basepix = PixelInfo::BASE4;
-    }      
-  }
-
-#pragma omp parallel shared (pixel_list) firstprivate (q)
+  std::vector<Npoint_Functions::PixelInfo> pixel_list;
+  Npoint_Functions::rhombic_pixel_list (q.Nside(), pixel_list);
+  std::vector<char> pixel_base;
+  Npoint_Functions::rhombic_pixel_base (q.Nside(), pixel_list, pixel_base);
+  // Build the symmetry tables in parallel before the threads share them.
+  Npoint_Functions::Pixel_Symmetry_Tables::get (q.Nside(), q.Scheme());
+
+  /* One thread writes while the rest find the quadrilaterals.  The writer
+   * spends most of its time waiting so it is in addition to the usual
+   * number of threads. */
+  int Nthreads_max = 1;
+#ifdef OMP
+  Nthreads_max = omp_get_max_threads() + 1;
+#endif
+  Quad_Output output (buffer_bytes, binary);
+  size_t next_pixel = 0;
+
+#pragma omp parallel num_threads(Nthreads_max) shared (pixel_list, pixel_base, output, next_pixel) firstprivate (q)
   {
-    std::vector<int> tri;
-    std::vector<int> thirdpt;
-    thirdpt.reserve(1000);
-    int pix;
-    
-    PixelTrans pixtrans (q.Nside(), q.Scheme());
-
-    /* Buffer space.  We save the quadrilaterals in a buffer and then
-     * write them out all at once.  This is done so that we don't have
-     * threads fighting each other to get write access.  We can't have them
-     * all write at once.
-     */
-    // Number of quad space we want to reserve.  This is a bit under 500MB.
-    const size_t Nbuf = 30000000;
-    simple_vector<int> quad_buf(4*Nbuf);
-    
-#pragma omp for schedule(dynamic,1)
-    for (size_t j=0; j < pixel_list.size(); ++j) {
-      pix = pixel_list[j].pixnum; // shorthand
-      q.initialize(pix);
-      while (q.next(tri, thirdpt)) {
-        // First add the quads.
-        add_quads (tri, thirdpt, quad_buf);
-        // Next shift by base pixel 3 times.
-        for (int n=0; n < 3; ++n) {
-          pixtrans.shift_by_base (tri);
-          pixtrans.shift_by_base (thirdpt);
-          add_quads (tri, thirdpt, quad_buf);
-        }
-        // Then reflect through z=0 line
-        pixtrans.reflect_through_z0 (tri);
-        pixtrans.reflect_through_z0 (thirdpt);
-        add_quads (tri, thirdpt, quad_buf);
-        // and shift by base pixel 3 times.
-        for (int n=0; n < 3; ++n) {
-          pixtrans.shift_by_base (tri);
-          pixtrans.shift_by_base (thirdpt);
-          add_quads (tri, thirdpt, quad_buf);
-        }
+    int Nthreads = 1, tid = 0;
+#ifdef OMP
+    Nthreads = omp_get_num_threads();
+    tid = omp_get_thread_num();
+#endif
+#pragma omp single
+    output.set_workers (Nthreads - 1);
 
-        // If we have a base0 pixel we are done
-        if (pixel_list[j].basepix == PixelInfo::BASE0) continue;
-
-        // Otherwise we have more transformations to do.
-        // Reflect through z-axis
-        pixtrans.reflect_through_zaxis (tri);
-        pixtrans.reflect_through_zaxis (thirdpt);
-        add_quads (tri, thirdpt, quad_buf);
-        // and shift by base pixel 3 times.
-        for (int n=0; n < 3; ++n) {
-          pixtrans.shift_by_base (tri);
-          pixtrans.shift_by_base (thirdpt);
-          add_quads (tri, thirdpt, quad_buf);
-        }
-        // Then reflect through z=0 line
-        pixtrans.reflect_through_z0 (tri);
-        pixtrans.reflect_through_z0 (thirdpt);
-        add_quads (tri, thirdpt, quad_buf);
-        // and shift by base pixel 3 times.
-        for (int n=0; n < 3; ++n) {
-          pixtrans.shift_by_base (tri);
-          pixtrans.shift_by_base (thirdpt);
-          add_quads (tri, thirdpt, quad_buf);
+    if ((Nthreads > 1) && (tid == 0)) {
+      output.run_writer();
+    } else {
+      std::vector<int> tri;
+      std::vector<int> thirdpt;
+      thirdpt.reserve(1000);
+      size_t j;
+
+      // Only the canonical images are written so no quad is repeated.
+      Npoint_Functions::Rhombic_Symmetry_Images<int> images (q, pixel_base);
+      Quad_Adder adder (output);
+
+      while (true) {
+#pragma omp atomic capture
+        j = next_pixel++;
+        if (j >= pixel_list.size()) break;
+        q.initialize (pixel_list[j].pixnum);
+        while (q.next(tri, thirdpt)) {
+          images (pixel_list[j].basepix, tri, thirdpt, adder);
         }
       }
+      adder.finish();
     }
-    write_quad_buffer (quad_buf);
   }
 
   return 0;
@@ -8,7 +8,6 @@
 #include <healpix_base.h>
 #include <healpix_map.h>
 #include <healpix_map_fitsio.h>
-#include <string_utils.h> // For parsing a text file
 #include <paramfile.h>
 #include <vec3.h>
 
@@ -41,42 +40,6 @@ namespace {
   ("$Id: create_twopt_table.cpp,v 1.13 2016/02/09 20:31:44 copi Exp $");
 }
 
-void mask_to_pixlist (const Healpix_Map<double>& mask,
-                      std::vector<int>& pixlist)
-{
-  pixlist.clear();
-  for (int j=0; j < mask.Npix(); ++j) {
-    if (mask[j] > 0.5) pixlist.push_back(j);
-  }
-}
-
-bool read_text_file (const std::string& cosbinfile,
-                     std::vector<double>& bin_list)
-{
-  /* Read the file line by line and extract the first column.
-   *  Anything following a # is a comment.
-   */
-  std::string line;
-  std::string::iterator it;
-  std::vector<double> vals;
-  std::ifstream in (cosbinfile.c_str());
-  if (! in.is_open()) return false;
-
-  bin_list.clear();
-  while (in.good()) {
-    std::getline (in, line);
-    line = trim (line);
-    it = std::find (line.begin(), line.end(), '#');
-    if (it != line.end()) line.erase (it, line.end());
-    if (line == "") continue;
-    vals.clear();
-    split (line, vals);
-    bin_list.push_back(vals[0]);
-  }
-  in.close();
-  return true;
-}
-  
 void usage (const char *progname)
 {
   std::cerr << "Usage: " << progname << " <parameter file name>\n";
@@ -93,9 +56,6 @@ int main (int argc, char *argv[])
   paramfile params (argv[1]);
   int Nside = params.find<int> ("Nside", -1);
   std::string maskfile = params.find<std::string> ("maskfile", "");
-  double dcosbin = params.find<double> ("dcosbin", -100);
-  double dtheta = params.find<double> ("dtheta", -200);
-  std::string cosbinfile = params.find<std::string> ("cosbinfile", "");
   std::string tmpfile_prefix = params.find<std::string> ("tmpfile_prefix");
   std::string twoptfile_prefix = params.find<std::string> ("twoptfile_prefix");
   bool clean_tmpfiles = params.find<bool> ("clean_tmpfiles", false);
@@ -105,75 +65,32 @@ int main (int argc, char *argv[])
     return 1;
   }
 
-  if ((dcosbin == -100) && (cosbinfile == "") && (dtheta == -200)) {
-    std::cerr << "cosbinfile or dcosbin or dtheta must be set in the parameter file.\n";
-    return 1;
-  }
+  std::vector<double> cosbin;
+  if (! Npoint_Functions::create_bins (params, bin_list, cosbin)) return 1;
 
   Healpix_Map<double> mask;
   if (maskfile != "") {
     read_Healpix_map_from_fits (maskfile, mask);
     if (mask.Scheme() == RING) mask.swap_scheme();
     Nside = mask.Nside();
-    mask_to_pixlist (mask, pixel_list);
+    Npoint_Functions::mask_to_pixlist (mask, pixel_list);
   } else {
     pixel_list.resize (12*Nside*Nside);
     std::generate (pixel_list.begin(), pixel_list.end(),
                    Npoint_Functions::myRange<int>());
   }
 
-  std::vector<double> cosbin;
-  if (cosbinfile != "") {
-    if (! read_text_file (cosbinfile, bin_list)) {
-      std::cerr << "Failed reading " << cosbinfile << std::endl;
-      return 1;
-    }
-  } else if (dcosbin != -100) {
-    int Nbin = 2/dcosbin;
-    bin_list.resize(Nbin);
-    std::generate (bin_list.begin(), bin_list.end(),
-                   Npoint_Functions::myRange<double>(-1.0+dcosbin/2,
-                                                     dcosbin));
-  } else {
-    int Nbin = 180/dtheta;
-    bin_list.resize(Nbin);
-    /* Run this "backward" since we will use bins in cos(theta) and
-     * cos(180)=-1. */
-    std::generate (bin_list.begin(), bin_list.end(),
-                   Npoint_Functions::myRange<double>(180-dtheta/2,
-                                                     -dtheta));
-    /* We want equal spacing/width in theta (I guess) so
-     * create cosbin here with this in mind. */
-    cosbin.push_back(-1.1);
-    for (size_t j=0; j < bin_list.size()-1; ++j) {
-      cosbin.push_back(cos(0.5*(bin_list[j]+bin_list[j+1])*M_PI/180));
-    }
-    cosbin.push_back(1.1);
-  }
-
-  /* Convert bin_list to bin edges. Put the ends of the bins a little off
-   * the min and max values so we don't have to deal with the dot product
-   * numerically being a little too big or small.
-   */  
-  if (cosbin.size() == 0) {
-    cosbin.push_back(-1.1);
-    for (size_t j=0; j < bin_list.size()-1; ++j) {
-      cosbin.push_back(0.5*(bin_list[j]+bin_list[j+1]));
-    }
-    cosbin.push_back(1.1);
-  }
-
   size_t Npix = pixel_list.size();
   std::cout << "Generating for\n Nside = " << Nside
             << "\n Npix = " << Npix
             << "\n Nbin = " << bin_list.size()
             << std::endl;
 
-  Healpix_Base HBase (Nside, NEST, SET_NSIDE);
   // Create list of vectors.
+  const vec3 *allvec = Npoint_Functions::pixel_vectors (Nside, NEST);
   std::vector<vec3> veclist (Npix);
   for (size_t i=0; i < Npix; ++i) {
-    veclist[i] = HBase.pix2vec (pixel_list[i]);
+    veclist[i] = allvec[pixel_list[i]];
   }
 
   std::vector<Npoint_Functions::buffered_pair_binary_file<int> > binfiles;
@@ -15,7 +15,7 @@ int main ()
 
   Npoint_Functions::Twopt_Table<int> twopt_table;
   twopt_table.read_file (Npoint_Functions::make_filename (twopt_prefix,
-                                                          150)); 
+                                                          150), true);
   Npoint_Functions::Pixel_Triangles_Equilateral<int> triangles;
   std::vector<int> tri;
   std::vector<int> thirdpt;